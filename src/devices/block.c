@@ -3,7 +3,16 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+
+/* Limits on a transfer that the worker merges from several
+   requests: the number of sectors, and the number of buffers
+   that it scatters to or gathers from. */
+#define MERGE_MAX 128
+#define MERGE_IOV_MAX 16
 
 /* A block device. */
 struct block
@@ -19,6 +28,19 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* Request queue.  Not used if the driver is stacked. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct condition queue_ready;       /* Signaled when queue not empty. */
+    struct list queue;                  /* Pending requests, by sector. */
+    size_t queue_depth;                 /* Number of pending requests. */
+    block_sector_t head;                /* Sector after last one transferred. */
+
+    unsigned long long request_cnt;     /* Number of requests completed. */
+    unsigned long long merge_cnt;       /* Requests merged into another. */
+    unsigned long long depth_sum;       /* Sum of queue depths on submit. */
+    size_t depth_max;                   /* Deepest the queue has been. */
+    int64_t latency_sum;                /* Sum of ticks from submit to done. */
   };
 
 /* List of all block devices. */
@@ -28,6 +50,9 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void transfer (struct block *, bool write, block_sector_t,
+                      const struct block_iovec *, size_t iov_cnt);
+static thread_func block_worker NO_RETURN;
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -120,9 +145,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_multiple (block, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +156,316 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  block_write_multiple (block, sector, 1, buffer);
+}
+
+/* Verifies that the CNT sectors starting at SECTOR are all
+   within BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector,
+               block_sector_t cnt)
+{
+  if (cnt > 0)
+    {
+      check_sector (block, sector);
+      if (cnt > block->size - sector)
+        check_sector (block, block->size);
+    }
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  If the driver supports it, this is a single request to
+   the device, which is much faster than reading the sectors one
+   at a time.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     block_sector_t cnt, void *buffer)
+{
+  struct block_iovec iov;
+
+  iov.buffer = buffer;
+  iov.cnt = cnt;
+  block_readv (block, sector, &iov, 1);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving the
+   data.  If the driver supports it, this is a single request to
+   the device.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      block_sector_t cnt, const void *buffer)
+{
+  struct block_iovec iov;
+
+  iov.buffer = (void *) buffer;
+  iov.cnt = cnt;
+  block_writev (block, sector, &iov, 1);
+}
+
+/* Reads consecutive sectors starting at SECTOR from BLOCK,
+   scattering them across the IOV_CNT buffers in IOV in order.
+   Drivers that support it read them all in a single request.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_readv (struct block *block, block_sector_t sector,
+             const struct block_iovec *iov, size_t iov_cnt)
+{
+  struct block_request r;
+
+  block_request_init (&r, false, sector, iov, iov_cnt);
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
+/* Writes consecutive sectors starting at SECTOR to BLOCK,
+   gathering them from the IOV_CNT buffers in IOV in order.
+   Returns after the block device has acknowledged receiving the
+   data.  Drivers that support it write them all in a single
+   request.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_writev (struct block *block, block_sector_t sector,
+              const struct block_iovec *iov, size_t iov_cnt)
+{
+  struct block_request r;
+
+  block_request_init (&r, true, sector, iov, iov_cnt);
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
+/* Initializes R as a request to read or, if WRITE is true,
+   write consecutive sectors starting at SECTOR, using the
+   IOV_CNT buffers in IOV.  The request completes by upping its
+   semaphore; set R->complete afterward to be called back
+   instead. */
+void
+block_request_init (struct block_request *r, bool write,
+                    block_sector_t sector,
+                    const struct block_iovec *iov, size_t iov_cnt)
+{
+  size_t i;
+
+  r->write = write;
+  r->sector = sector;
+  r->cnt = 0;
+  for (i = 0; i < iov_cnt; i++)
+    r->cnt += iov[i].cnt;
+  r->iov = iov;
+  r->iov_cnt = iov_cnt;
+  r->complete = NULL;
+  r->aux = NULL;
+  sema_init (&r->done, 0);
+}
+
+/* Returns true if request A starts at a lower sector than
+   request B. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+  return a->sector < b->sector;
+}
+
+/* Finishes request R. */
+static void
+complete_request (struct block_request *r)
+{
+  if (r->complete != NULL)
+    r->complete (r);
+  else
+    sema_up (&r->done);
+}
+
+/* Queues request R on BLOCK and returns without waiting for it
+   to complete.  R must stay valid until it does. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  check_sectors (block, r->sector, r->cnt);
+  if (r->write)
+    {
+      ASSERT (block->type != BLOCK_FOREIGN);
+      block->write_cnt += r->cnt;
+    }
+  else
+    block->read_cnt += r->cnt;
+  r->submit_time = timer_ticks ();
+
+  /* A stacked driver will queue the request at the underlying
+     device, so pass it straight through. */
+  if (block->ops->stacked)
+    {
+      transfer (block, r->write, r->sector, r->iov, r->iov_cnt);
+      complete_request (r);
+      return;
+    }
+
+  trace (r->write ? TRACE_BLOCK_WRITE : TRACE_BLOCK_READ, r->sector, r->cnt);
+  lock_acquire (&block->queue_lock);
+  list_insert_ordered (&block->queue, &r->elem, request_less, NULL);
+  block->queue_depth++;
+  block->depth_sum += block->queue_depth;
+  if (block->queue_depth > block->depth_max)
+    block->depth_max = block->queue_depth;
+  cond_signal (&block->queue_ready, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Waits for request R, which must not have a completion
+   function, to complete. */
+void
+block_wait (struct block_request *r)
+{
+  ASSERT (r->complete == NULL);
+  sema_down (&r->done);
+}
+
+/* Transfers consecutive sectors starting at SECTOR between
+   BLOCK and the IOV_CNT buffers in IOV using BLOCK's driver. */
+static void
+transfer (struct block *block, bool write, block_sector_t sector,
+          const struct block_iovec *iov, size_t iov_cnt)
+{
+  size_t i;
+
+  if (write && block->ops->writev != NULL)
+    block->ops->writev (block->aux, sector, iov, iov_cnt);
+  else if (!write && block->ops->readv != NULL)
+    block->ops->readv (block->aux, sector, iov, iov_cnt);
+  else
+    for (i = 0; i < iov_cnt; i++)
+      {
+        uint8_t *buffer = iov[i].buffer;
+        block_sector_t j;
+
+        for (j = 0; j < iov[i].cnt; j++)
+          {
+            if (write)
+              block->ops->write (block->aux, sector, buffer);
+            else
+              block->ops->read (block->aux, sector, buffer);
+            sector++;
+            buffer += BLOCK_SECTOR_SIZE;
+          }
+      }
+}
+
+/* Removes the next requests to serve from BLOCK's queue and
+   stores them in BATCH, returning how many there are.  They
+   cover consecutive sectors in the same direction, *CNT in all.
+
+   Uses C-LOOK: the head sweeps toward higher sectors, serving
+   the first request at or beyond it, and once nothing is left
+   ahead it jumps back to the lowest pending sector.  Following
+   requests that continue the first one are merged with it, up
+   to MERGE_MAX sectors in MERGE_IOV_MAX buffers. */
+static size_t
+next_batch (struct block *block, struct block_request *batch[MERGE_IOV_MAX],
+            block_sector_t *cnt)
+{
+  struct block_request *first;
+  struct list_elem *e;
+  size_t iov_cnt;
+  size_t n;
+
+  ASSERT (lock_held_by_current_thread (&block->queue_lock));
+  ASSERT (!list_empty (&block->queue));
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    if (list_entry (e, struct block_request, elem)->sector >= block->head)
+      break;
+  if (e == list_end (&block->queue))
+    e = list_begin (&block->queue);
+
+  first = list_entry (e, struct block_request, elem);
+  e = list_remove (e);
+  batch[0] = first;
+  n = 1;
+  *cnt = first->cnt;
+  iov_cnt = first->iov_cnt;
+  while (e != list_end (&block->queue) && n < MERGE_IOV_MAX)
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (r->write != first->write
+          || r->sector != first->sector + *cnt
+          || *cnt + r->cnt > MERGE_MAX
+          || iov_cnt + r->iov_cnt > MERGE_IOV_MAX)
+        break;
+      e = list_remove (e);
+      batch[n++] = r;
+      *cnt += r->cnt;
+      iov_cnt += r->iov_cnt;
+    }
+
+  block->head = first->sector + *cnt;
+  block->queue_depth -= n;
+  block->merge_cnt += n - 1;
+  return n;
+}
+
+/* Serves BLOCK's request queue, one batch at a time.  A merged
+   batch is a single transfer that scatters to or gathers from
+   the buffers of all of its requests. */
+static void
+block_worker (void *block_)
+{
+  struct block *block = block_;
+
+  for (;;)
+    {
+      struct block_request *batch[MERGE_IOV_MAX];
+      struct block_iovec iov[MERGE_IOV_MAX];
+      struct block_request *first;
+      block_sector_t cnt;
+      size_t iov_cnt;
+      int64_t now;
+      size_t n, i;
+
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->queue))
+        cond_wait (&block->queue_ready, &block->queue_lock);
+      n = next_batch (block, batch, &cnt);
+      lock_release (&block->queue_lock);
+
+      first = batch[0];
+      if (n == 1)
+        transfer (block, first->write, first->sector,
+                  first->iov, first->iov_cnt);
+      else
+        {
+          for (i = iov_cnt = 0; i < n; i++)
+            {
+              memcpy (iov + iov_cnt, batch[i]->iov,
+                      batch[i]->iov_cnt * sizeof *iov);
+              iov_cnt += batch[i]->iov_cnt;
+            }
+          transfer (block, first->write, first->sector, iov, iov_cnt);
+        }
+
+      now = timer_ticks ();
+      lock_acquire (&block->queue_lock);
+      block->request_cnt += n;
+      for (i = 0; i < n; i++)
+        block->latency_sum += now - batch[i]->submit_time;
+      lock_release (&block->queue_lock);
+
+      for (i = 0; i < n; i++)
+        complete_request (batch[i]);
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -164,6 +493,7 @@ block_type (struct block *block)
 void
 block_print_stats (void)
 {
+  struct list_elem *e;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
@@ -176,6 +506,21 @@ block_print_stats (void)
                   block->read_cnt, block->write_cnt);
         }
     }
+
+  /* Role devices are often partitions, which queue their
+     requests at the underlying disk, so report every queue. */
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, list_elem);
+      if (!block->ops->stacked && block->request_cnt > 0)
+        printf ("%s queue: %llu requests, %llu merged, "
+                "average depth %llu, max depth %zu, "
+                "average latency %lld ticks\n",
+                block->name, block->request_cnt, block->merge_cnt,
+                block->depth_sum / block->request_cnt, block->depth_max,
+                block->latency_sum / (int64_t) block->request_cnt);
+    }
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -200,6 +545,11 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->request_cnt = 0;
+  block->merge_cnt = 0;
+  block->depth_sum = 0;
+  block->depth_max = 0;
+  block->latency_sum = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -208,6 +558,16 @@ block_register (const char *name, enum block_type type,
     printf (", %s", extra_info);
   printf ("\n");
 
+  if (!ops->stacked)
+    {
+      lock_init (&block->queue_lock);
+      cond_init (&block->queue_ready);
+      list_init (&block->queue);
+      block->queue_depth = 0;
+      block->head = 0;
+      thread_create (block->name, PRI_DEFAULT, block_worker, block);
+    }
+
   return block;
 }
 
@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,9 +55,57 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, block_sector_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, block_sector_t cnt,
+                           const void *);
+
+/* One piece of a scatter-gather buffer: CNT sectors at BUFFER. */
+struct block_iovec
+  {
+    void *buffer;
+    block_sector_t cnt;
+  };
+
+void block_readv (struct block *, block_sector_t,
+                  const struct block_iovec *, size_t iov_cnt);
+void block_writev (struct block *, block_sector_t,
+                   const struct block_iovec *, size_t iov_cnt);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests.
+
+   block_submit() queues a request and returns at once.  Each
+   device's requests are served by its own worker thread in
+   C-LOOK order, merging requests for adjacent sectors.  When a
+   request finishes, the worker calls its COMPLETE function if
+   one was set, otherwise it ups the request's DONE semaphore,
+   which block_wait() downs.  COMPLETE runs in the worker thread,
+   so it must not wait for another request on the same device.
+
+   The order in which overlapping requests are served is
+   unspecified, so don't have a read and a write of the same
+   sector outstanding at once. */
+struct block_request
+  {
+    struct list_elem elem;              /* Element in device's queue. */
+    bool write;                         /* Write to device or read from it? */
+    block_sector_t sector;              /* First sector. */
+    block_sector_t cnt;                 /* Number of sectors. */
+    const struct block_iovec *iov;      /* Buffers, in kernel memory. */
+    size_t iov_cnt;                     /* Number of elements in IOV. */
+    void (*complete) (struct block_request *); /* Completion function. */
+    void *aux;                          /* For use by COMPLETE. */
+    struct semaphore done;              /* Upped when done, if no COMPLETE. */
+    int64_t submit_time;                /* Timer tick of submission. */
+  };
+
+void block_request_init (struct block_request *, bool write, block_sector_t,
+                         const struct block_iovec *, size_t iov_cnt);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
 
@@ -65,6 +115,21 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer consecutive sectors, scattered across
+       or gathered from the IOV_CNT buffers in IOV, in as few
+       requests to the device as possible.  If null, the block
+       layer calls read or write once per sector instead. */
+    void (*readv) (void *aux, block_sector_t,
+                   const struct block_iovec *iov, size_t iov_cnt);
+    void (*writev) (void *aux, block_sector_t,
+                    const struct block_iovec *iov, size_t iov_cnt);
+
+    /* True if the driver only forwards requests to another
+       block device, as partitions do.  Such devices have no
+       request queue of their own; their requests are queued at
+       the underlying device instead. */
+    bool stacked;
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -5,13 +5,23 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Data normally moves by PIO, through the data register.  With
+   the "-dma" option, if the channels belong to a PCI bus-master
+   IDE controller, such as the PIIX that QEMU emulates, transfers
+   to and from kernel memory use bus-master DMA instead, so that
+   other threads can run while the controller moves the data. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -34,6 +44,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +60,47 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Bus-master IDE port addresses, relative to a channel's
+   bus-master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)  /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)   /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRDT address. */
+
+/* Bus-master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from device to memory. */
+
+/* Bus-master Status Register bits. */
+#define BM_STA_ERR 0x02         /* Error (write 1 to clear). */
+#define BM_STA_INTR 0x04        /* Interrupt (write 1 to clear). */
+
+/* A physical region descriptor, which tells the bus-master
+   controller about one physically contiguous part of a DMA
+   buffer.  A region may not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes, 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT on last entry. */
+  };
+
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT 64              /* Entries per channel's table. */
+
+/* Maximum number of sectors in one READ or WRITE SECTOR command.
+   The sector count register holds 0 for this count. */
+#define MAX_SECTORS_PER_CMD 256
+
+/* A position within a scatter-gather buffer. */
+struct iov_cursor
+  {
+    const struct block_iovec *iov;      /* Current buffer. */
+    size_t iov_cnt;                     /* Buffers left, including IOV. */
+    block_sector_t ofs;                 /* Sector offset within IOV. */
+  };
 
 /* An ATA device. */
 struct ata_disk
@@ -72,6 +124,9 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus-master base port, 0 if no DMA. */
+    struct prd *prdt;           /* Physical region descriptor table. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,11 +136,26 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+bool ide_dma;
+
+static void init_dma (void);
+static bool dma_possible (const struct channel *,
+                          const struct block_iovec *, size_t iov_cnt);
+static block_sector_t dma_transfer (struct ata_disk *, block_sector_t,
+                                    struct iov_cursor *, block_sector_t cnt,
+                                    bool read);
+
+static void cursor_init (struct iov_cursor *,
+                         const struct block_iovec *, size_t iov_cnt);
+static void *cursor_sector (const struct iov_cursor *);
+static void cursor_advance (struct iov_cursor *, block_sector_t cnt);
+
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sectors (struct ata_disk *, block_sector_t,
+                            block_sector_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -153,6 +223,47 @@ ide_init (void)
         if (c->devices[dev_no].is_ata)
           identify_ata_device (&c->devices[dev_no]);
     }
+
+  if (ide_dma)
+    init_dma ();
+}
+
+/* Looks for a PCI bus-master IDE controller and, if there is one,
+   sets up both channels to use it. */
+static void
+init_dma (void) 
+{
+  struct pci_address addr;
+  uint32_t bar;
+  struct prd *prdt;
+  size_t chan_no;
+
+  /* Class 1 is mass storage, subclass 1 is IDE. */
+  if (!pci_find_class (0x01, 0x01, &addr))
+    {
+      printf ("ide: no bus-master controller, using PIO\n");
+      return;
+    }
+  bar = pci_read_config (addr, PCI_REG_BAR (4));
+  if (!(bar & 1) || (bar & ~3u) == 0)
+    {
+      printf ("ide: controller lacks bus-master ports, using PIO\n");
+      return;
+    }
+  pci_write_config (addr, PCI_REG_COMMAND,
+                    (pci_read_config (addr, PCI_REG_COMMAND)
+                     | PCI_CMD_IO | PCI_CMD_MASTER));
+
+  prdt = palloc_get_page (PAL_ASSERT);
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) 
+    {
+      struct channel *c = &channels[chan_no];
+      c->bm_base = (bar & ~3u) + 8 * chan_no;
+      c->prdt = prdt + PRD_CNT * chan_no;
+      outb (reg_bm_command (c), 0);
+      outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+    }
+  printf ("ide: using bus-master DMA, ports 0x%04"PRIx32"\n", bar & ~3u);
 }
 
 /* Disk detection and identification. */
@@ -337,23 +448,99 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
+/* Transfers consecutive sectors starting at SEC_NO between disk
+   D and the IOV_CNT buffers in IOV, reading from the disk if READ
+   is true or writing to it otherwise.  Each command transfers up
+   to MAX_SECTORS_PER_CMD sectors, filling the ATA sector count
+   register so that there is only one round of device selection
+   and command setup per command.  By PIO there is one interrupt
+   per sector; by DMA, one per command. */
+static void
+transfer_sectors (struct ata_disk *d, block_sector_t sec_no,
+                  const struct block_iovec *iov, size_t iov_cnt, bool read)
+{
+  struct channel *c = d->channel;
+  struct iov_cursor cur;
+  block_sector_t cnt;
+  bool dma;
+  size_t i;
+
+  for (i = cnt = 0; i < iov_cnt; i++)
+    cnt += iov[i].cnt;
+  cursor_init (&cur, iov, iov_cnt);
+  dma = dma_possible (c, iov, iov_cnt);
+
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      block_sector_t chunk = cnt < MAX_SECTORS_PER_CMD
+                             ? cnt : MAX_SECTORS_PER_CMD;
+
+      if (dma)
+        chunk = dma_transfer (d, sec_no, &cur, chunk, read);
+      else
+        {
+          select_sectors (d, sec_no, chunk);
+          issue_pio_command (c, (read ? CMD_READ_SECTOR_RETRY
+                                 : CMD_WRITE_SECTOR_RETRY));
+          for (i = 0; i < chunk; i++)
+            {
+              if (read)
+                sema_down (&c->completion_wait);
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+                       d->name, read ? "read" : "write", sec_no + i);
+              if (read)
+                input_sector (c, cursor_sector (&cur));
+              else
+                {
+                  output_sector (c, cursor_sector (&cur));
+                  sema_down (&c->completion_wait);
+                }
+              cursor_advance (&cur, 1);
+            }
+        }
+      sec_no += chunk;
+      cnt -= chunk;
+    }
+  lock_release (&c->lock);
+}
+
+/* Reads consecutive sectors starting at SEC_NO from disk D into
+   the IOV_CNT buffers in IOV.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_readv (void *d, block_sector_t sec_no,
+           const struct block_iovec *iov, size_t iov_cnt)
+{
+  transfer_sectors (d, sec_no, iov, iov_cnt, true);
+}
+
+/* Writes consecutive sectors starting at SEC_NO to disk D from
+   the IOV_CNT buffers in IOV.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_writev (void *d, block_sector_t sec_no,
+            const struct block_iovec *iov, size_t iov_cnt)
+{
+  transfer_sectors (d, sec_no, iov, iov_cnt, false);
+}
+
 /* Reads sector SEC_NO from disk D into BUFFER, which must have
    room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read (void *d, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  struct block_iovec iov;
+
+  iov.buffer = buffer;
+  iov.cnt = 1;
+  transfer_sectors (d, sec_no, &iov, 1, true);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -362,38 +549,39 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  struct block_iovec iov;
+
+  iov.buffer = (void *) buffer;
+  iov.cnt = 1;
+  transfer_sectors (d, sec_no, &iov, 1, false);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_readv,
+    ide_writev,
+    false
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection
+   registers.  (We use LBA mode.)  CNT must be between 1 and
+   MAX_SECTORS_PER_CMD. */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no,
+                block_sector_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_CMD);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_SECTORS_PER_CMD ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -430,6 +618,140 @@ output_sector (struct channel *c, const void *sector)
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
 }
 
+/* Returns true if channel C can transfer to or from the IOV_CNT
+   buffers in IOV by DMA.  The buffers must be in kernel memory,
+   whose virtual addresses map linearly onto physical memory;
+   user addresses need not be physically contiguous or even
+   present. */
+static bool
+dma_possible (const struct channel *c,
+              const struct block_iovec *iov, size_t iov_cnt)
+{
+  size_t i;
+
+  if (c->bm_base == 0)
+    return false;
+  for (i = 0; i < iov_cnt; i++)
+    {
+      const uint8_t *start = iov[i].buffer;
+      const uint8_t *end = start + iov[i].cnt * BLOCK_SECTOR_SIZE;
+
+      if (iov[i].cnt == 0)
+        continue;
+      if (!is_kernel_vaddr (start)
+          || (uintptr_t) start % 2 != 0
+          || end <= start
+          || (uintptr_t) vtop (end - 1) >= init_ram_pages * PGSIZE)
+        return false;
+    }
+  return true;
+}
+
+/* Transfers up to CNT sectors starting at SEC_NO between disk D
+   and the buffers at *CUR by bus-master DMA, reading from the
+   disk if READ is true or writing to it otherwise, and advances
+   *CUR past them.  Returns the number of sectors transferred,
+   which is less than CNT only if the buffers are too scattered
+   to describe in one PRD table.  The caller must hold the
+   channel's lock and have checked dma_possible().  The current
+   thread sleeps for the duration of the transfer. */
+static block_sector_t
+dma_transfer (struct ata_disk *d, block_sector_t sec_no,
+              struct iov_cursor *cur, block_sector_t cnt, bool read)
+{
+  struct channel *c = d->channel;
+  uint8_t dir = read ? BM_CMD_READ : 0;
+  uint8_t bm_status, status;
+  block_sector_t done;
+  int i;
+
+  /* Build the PRD table, one or more regions per buffer,
+     splitting at 64 kB boundaries.  A piece of at most
+     MAX_SECTORS_PER_CMD sectors (128 kB) needs at most 3
+     regions. */
+  for (i = 0, done = 0; done < cnt && i + 3 <= PRD_CNT; )
+    {
+      block_sector_t piece = cur->iov->cnt - cur->ofs;
+      uint32_t phys = vtop (cursor_sector (cur));
+      size_t size;
+
+      if (piece > cnt - done)
+        piece = cnt - done;
+      for (size = piece * BLOCK_SECTOR_SIZE; size > 0; i++)
+        {
+          size_t chunk = 0x10000 - (phys & 0xffff);
+          if (chunk > size)
+            chunk = size;
+
+          c->prdt[i].addr = phys;
+          c->prdt[i].size = chunk & 0xffff;
+          c->prdt[i].flags = 0;
+          phys += chunk;
+          size -= chunk;
+        }
+      cursor_advance (cur, piece);
+      done += piece;
+    }
+  ASSERT (done > 0);
+  c->prdt[i - 1].flags = PRD_EOT;
+
+  /* Program the controller, then the disk, then start. */
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), dir);
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+  select_sectors (d, sec_no, done);
+  issue_pio_command (c, read ? CMD_READ_DMA : CMD_WRITE_DMA);
+  outb (reg_bm_command (c), dir | BM_CMD_START);
+
+  sema_down (&c->completion_wait);
+
+  outb (reg_bm_command (c), dir);
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+  status = inb (reg_alt_status (c));
+  if ((bm_status & BM_STA_ERR) || (status & (STA_ERR | STA_BSY)))
+    PANIC ("%s: DMA %s failed, sector=%"PRDSNu,
+           d->name, read ? "read" : "write", sec_no);
+  return done;
+}
+
+/* Scatter-gather buffer positions. */
+
+/* Positions CUR at the start of the IOV_CNT buffers in IOV. */
+static void
+cursor_init (struct iov_cursor *cur,
+             const struct block_iovec *iov, size_t iov_cnt)
+{
+  cur->iov = iov;
+  cur->iov_cnt = iov_cnt;
+  cur->ofs = 0;
+  cursor_advance (cur, 0);
+}
+
+/* Returns the address of the sector at CUR. */
+static void *
+cursor_sector (const struct iov_cursor *cur)
+{
+  ASSERT (cur->iov_cnt > 0);
+  return (uint8_t *) cur->iov->buffer + cur->ofs * BLOCK_SECTOR_SIZE;
+}
+
+/* Advances CUR by CNT sectors, which must not take it past the
+   end of its current buffer, then skips past any exhausted or
+   empty buffers. */
+static void
+cursor_advance (struct iov_cursor *cur, block_sector_t cnt)
+{
+  cur->ofs += cnt;
+  while (cur->iov_cnt > 0 && cur->ofs >= cur->iov->cnt)
+    {
+      ASSERT (cur->ofs == cur->iov->cnt);
+      cur->iov++;
+      cur->iov_cnt--;
+      cur->ofs = 0;
+    }
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -1,6 +1,12 @@
 #ifndef DEVICES_IDE_H
 #define DEVICES_IDE_H
 
+#include <stdbool.h>
+
+/* Use bus-master DMA if a controller supports it?
+   Controlled by kernel command-line option "-dma". */
+extern bool ide_dma;
+
 void ide_init (void);
 
 #endif /* devices/ide.h */
@@ -0,0 +1,86 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/io.h"
+
+/* The code in this file reads and writes PCI configuration space
+   through the I/O ports of configuration mechanism #1, which
+   every PC chipset since the original PCI ones supports.  It
+   does no more than is needed to locate devices and program
+   them. */
+
+/* Configuration mechanism #1 ports. */
+#define CONFIG_ADDRESS 0xcf8
+#define CONFIG_DATA 0xcfc
+
+/* Vendor ID read from a slot that has no device. */
+#define NO_VENDOR 0xffff
+
+/* Selects register REG of the function at ADDR for the next
+   access through CONFIG_DATA. */
+static void
+select_register (struct pci_address addr, int reg)
+{
+  ASSERT (addr.dev < 32 && addr.func < 8);
+  ASSERT (reg >= 0 && reg < 256 && reg % 4 == 0);
+
+  outl (CONFIG_ADDRESS, (0x80000000 | (addr.bus << 16) | (addr.dev << 11)
+                         | (addr.func << 8) | reg));
+}
+
+/* Returns the 32-bit configuration register at offset REG of the
+   function at ADDR. */
+uint32_t
+pci_read_config (struct pci_address addr, int reg)
+{
+  select_register (addr, reg);
+  return inl (CONFIG_DATA);
+}
+
+/* Sets the 32-bit configuration register at offset REG of the
+   function at ADDR to VALUE. */
+void
+pci_write_config (struct pci_address addr, int reg, uint32_t value)
+{
+  select_register (addr, reg);
+  outl (CONFIG_DATA, value);
+}
+
+/* Searches the PCI buses for a function with the given CLASS and
+   SUBCLASS.  If one is found, stores its location in *ADDR and
+   returns true; otherwise, returns false. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_address *addr)
+{
+  int bus, dev, func;
+
+  for (bus = 0; bus < 256; bus++)
+    for (dev = 0; dev < 32; dev++)
+      for (func = 0; func < 8; func++)
+        {
+          struct pci_address a;
+          uint32_t class_reg;
+
+          a.bus = bus;
+          a.dev = dev;
+          a.func = func;
+          if ((pci_read_config (a, PCI_REG_ID) & 0xffff) == NO_VENDOR)
+            {
+              if (func == 0)
+                break;
+              continue;
+            }
+
+          class_reg = pci_read_config (a, PCI_REG_CLASS);
+          if ((class_reg >> 24) == class
+              && ((class_reg >> 16) & 0xff) == subclass)
+            {
+              *addr = a;
+              return true;
+            }
+
+          /* Only multifunction devices have functions 1...7. */
+          if (func == 0 && !(pci_read_config (a, PCI_REG_HEADER) & 0x800000))
+            break;
+        }
+  return false;
+}
@@ -0,0 +1,30 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Location of a PCI function. */
+struct pci_address
+  {
+    uint8_t bus;                /* Bus number, 0...255. */
+    uint8_t dev;                /* Device number, 0...31. */
+    uint8_t func;               /* Function number, 0...7. */
+  };
+
+/* Offsets of some registers in PCI configuration space. */
+#define PCI_REG_ID 0x00                 /* Device ID 31:16, vendor ID 15:0. */
+#define PCI_REG_COMMAND 0x04            /* Status 31:16, command 15:0. */
+#define PCI_REG_CLASS 0x08              /* Class 31:24, subclass 23:16. */
+#define PCI_REG_HEADER 0x0c             /* Header type 23:16. */
+#define PCI_REG_BAR(N) (0x10 + 4 * (N)) /* Base address register N. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001               /* Respond to I/O space accesses. */
+#define PCI_CMD_MASTER 0x0004           /* Allow bus mastering. */
+
+uint32_t pci_read_config (struct pci_address, int reg);
+void pci_write_config (struct pci_address, int reg, uint32_t);
+bool pci_find_class (uint8_t class, uint8_t subclass, struct pci_address *);
+
+#endif /* devices/pci.h */
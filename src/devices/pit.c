@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +78,43 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts CHANNEL counting down COUNT PIT cycles in mode 0, in
+   which the channel's output rises once, when the count reaches
+   0, and then stays high.  On channel 0 this is a one-shot timer
+   interrupt, COUNT / PIT_HZ seconds from now.  A COUNT of 0 is
+   treated as 65536.  Reconfiguring the channel cancels the
+   countdown. */
+void
+pit_start_one_shot (int channel, uint16_t count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb (PIT_PORT_COUNTER (channel), count);
+  outb (PIT_PORT_COUNTER (channel), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the number of PIT cycles left in CHANNEL's current
+   count. */
+uint16_t
+pit_read_count (int channel)
+{
+  enum intr_level old_level;
+  uint8_t low, high;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  /* Latch the count, then read it a byte at a time. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, channel << 6);
+  low = inb (PIT_PORT_COUNTER (channel));
+  high = inb (PIT_PORT_COUNTER (channel));
+  intr_set_level (old_level);
+
+  return (high << 8) | low;
+}
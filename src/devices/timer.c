@@ -1,6 +1,7 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
@@ -10,21 +11,37 @@
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 
-#if TIMER_FREQ < 19
-#error 8254 timer requires TIMER_FREQ >= 19
-#endif
-#if TIMER_FREQ > 1000
-#error TIMER_FREQ <= 1000 recommended
-#endif
+/* Number of timer interrupts per second. */
+int timer_freq = TIMER_FREQ_DEFAULT;
+
+/* Stop ticking while idle? */
+bool timer_tickless;
 
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Tickless idle.  While the idle thread waits with interrupts
+   from a one-shot countdown instead of the periodic tick,
+   one_shot_ticks is the number of ticks that the countdown
+   stands for and one_shot_count its length in PIT cycles.  Both
+   are 0 while the timer ticks periodically. */
+static int64_t one_shot_ticks;
+static unsigned one_shot_count;
+
+/* Threads blocked in timer_sleep(), in order of wakeup_tick.
+   Threads with the same wakeup_tick are in the order they went
+   to sleep.  Protected by disabling interrupts, since the timer
+   interrupt removes threads from it. */
+static struct list sleep_list = LIST_INITIALIZER (sleep_list);
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
 static intr_handler_func timer_interrupt;
+static bool wakeup_less (const struct list_elem *, const struct list_elem *,
+                         void *aux);
+static void end_one_shot (int64_t elapsed);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -35,6 +52,8 @@ static void real_time_delay (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
+  ASSERT (TIMER_FREQ >= TIMER_FREQ_MIN && TIMER_FREQ <= TIMER_FREQ_MAX);
+
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
@@ -85,15 +104,23 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.  The thread blocks until the timer interrupt
+   wakes it, so it uses no CPU time while it sleeps. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wakeup_tick = timer_ticks () + ticks;
+  list_insert_ordered (&sleep_list, &cur->elem, wakeup_less, NULL);
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -166,12 +193,111 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
-/* Timer interrupt handler. */
+/* Called by the idle thread, with interrupts off, just before
+   it halts the CPU.  In tickless mode, replaces the periodic
+   tick by a single interrupt at the next sleeping thread's
+   wakeup time, or as late as the PIT can count, so that an idle
+   CPU is not woken every tick for nothing.  Under the
+   multi-level feedback queue scheduler the interrupt comes no
+   later than the next whole second, when load_avg is due. */
+void
+timer_idle_enter (void)
+{
+  unsigned cycles_per_tick = PIT_HZ / TIMER_FREQ;
+  int64_t delta = UINT16_MAX / cycles_per_tick;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (!timer_tickless || one_shot_ticks != 0)
+    return;
+
+  if (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick - ticks < delta)
+        delta = t->wakeup_tick - ticks;
+    }
+  if (thread_mlfqs && TIMER_FREQ - ticks % TIMER_FREQ < delta)
+    delta = TIMER_FREQ - ticks % TIMER_FREQ;
+
+  /* Not worth it for less than two ticks. */
+  if (delta < 2)
+    return;
+
+  one_shot_ticks = delta;
+  one_shot_count = delta * cycles_per_tick;
+  pit_start_one_shot (0, one_shot_count);
+}
+
+/* Called with interrupts off when the idle thread stops running.
+   If a one-shot countdown is still running, because some other
+   interrupt woke a thread, accounts for the ticks that passed
+   and restores the periodic tick. */
+void
+timer_idle_exit (void)
+{
+  unsigned cycles_per_tick = PIT_HZ / TIMER_FREQ;
+  unsigned left;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (one_shot_ticks == 0)
+    return;
+
+  /* After running out, the count wraps around, and the
+     interrupt is still pending; it will count the last tick. */
+  left = pit_read_count (0);
+  if (left > one_shot_count)
+    end_one_shot (one_shot_ticks - 1);
+  else
+    end_one_shot ((one_shot_count - left) / cycles_per_tick);
+}
+
+/* Ends tickless idle, advancing the tick count by ELAPSED ticks
+   that passed without interrupts while the CPU was idle, and
+   restores the periodic tick. */
+static void
+end_one_shot (int64_t elapsed)
+{
+  ticks += elapsed;
+  thread_account_idle (elapsed);
+  one_shot_ticks = one_shot_count = 0;
+  pit_configure_channel (0, 2, TIMER_FREQ);
+}
+
+/* Timer interrupt handler.  Wakes the threads whose sleep is
+   over, which are at the front of sleep_list, so this costs
+   time only for the threads actually woken. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
+  /* A one-shot countdown from timer_idle_enter() ran out.  This
+     interrupt accounts for the last of the ticks it stood for. */
+  if (one_shot_ticks != 0)
+    end_one_shot (one_shot_ticks - 1);
+
   ticks++;
+  while (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick > ticks)
+        break;
+      list_pop_front (&sleep_list);
+      thread_unblock (t);
+    }
   thread_tick ();
+  thread_yield_to_higher ();
+}
+
+/* Returns true if thread A is to wake up before thread B. */
+static bool
+wakeup_less (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->wakeup_tick < b->wakeup_tick;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
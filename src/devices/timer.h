@@ -2,10 +2,21 @@
 #define DEVICES_TIMER_H
 
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
-/* Number of timer interrupts per second. */
-#define TIMER_FREQ 100
+/* Number of timer interrupts per second.  Set with the "-hz"
+   kernel command-line option, between TIMER_FREQ_MIN and
+   TIMER_FREQ_MAX. */
+#define TIMER_FREQ timer_freq
+#define TIMER_FREQ_DEFAULT 100
+#define TIMER_FREQ_MIN 19       /* 8254 timer requires at least 19 Hz. */
+#define TIMER_FREQ_MAX 1000
+extern int timer_freq;
+
+/* If true, the timer stops ticking while the CPU is idle.
+   Controlled by kernel command-line option "-tickless". */
+extern bool timer_tickless;
 
 void timer_init (void);
 void timer_calibrate (void);
@@ -26,4 +37,7 @@ void timer_ndelay (int64_t nanoseconds);
 
 void timer_print_stats (void);
 
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
 #endif /* devices/timer.h */
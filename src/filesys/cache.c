@@ -0,0 +1,375 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Buffer cache.
+
+   Keeps the CACHE_SIZE most recently used sectors of the file
+   system device in memory.  Every access to fs_device goes
+   through here, so a sector is never cached twice and the
+   cached copy is always the newest one.
+
+   Dirty sectors are written back when they are evicted, by the
+   write-behind thread every WRITE_BEHIND_TICKS timer ticks, and
+   by cache_flush() when the file system shuts down.  Sectors
+   that are likely to be read next can be handed to the
+   read-ahead thread with cache_read_ahead().
+
+   Locking: cache_lock protects the mapping from sectors to
+   cache entries, that is, each entry's `sector', `valid',
+   `accessed' and `pin_cnt' members.  An entry's own lock
+   protects its data and `dirty' flag and is held across the
+   disk I/O that fills or writes back the entry.  cache_lock may
+   be held while acquiring an entry's lock but not the other way
+   around.  An entry with a nonzero pin_cnt is in use and is
+   never chosen for eviction. */
+
+/* Number of sectors in the cache. */
+#define CACHE_SIZE 64
+
+/* Interval between write-behind flushes, in timer ticks. */
+#define WRITE_BEHIND_TICKS (5 * TIMER_FREQ)
+
+/* Maximum number of pending read-ahead requests. */
+#define READ_AHEAD_MAX 16
+
+/* A cached sector. */
+struct cache_entry
+  {
+    block_sector_t sector;              /* Sector number, if valid. */
+    bool valid;                         /* Holds a sector? */
+    bool accessed;                      /* Used since the clock hand passed? */
+    int pin_cnt;                        /* Number of users. */
+
+    struct lock lock;                   /* Protects data and dirty. */
+    bool dirty;                         /* Differs from disk? */
+    uint8_t *data;                      /* BLOCK_SECTOR_SIZE bytes. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;
+static struct condition cache_unpinned; /* Signaled when pin_cnt drops to 0. */
+static size_t clock_hand;               /* Next entry to consider for eviction. */
+
+/* Read-ahead queue, a ring buffer of sector numbers. */
+static block_sector_t read_ahead_queue[READ_AHEAD_MAX];
+static size_t read_ahead_head;          /* Index of oldest request. */
+static size_t read_ahead_cnt;           /* Number of queued requests. */
+static struct lock read_ahead_lock;
+static struct condition read_ahead_ready;
+
+static struct cache_entry *cache_get (block_sector_t, bool load);
+static void cache_put (struct cache_entry *, bool dirty);
+static struct cache_entry *lookup (block_sector_t);
+static struct cache_entry *choose_victim (void);
+static thread_func write_behind_thread NO_RETURN;
+static thread_func read_ahead_thread NO_RETURN;
+
+/* Initializes the buffer cache and starts its write-behind and
+   read-ahead threads. */
+void
+cache_init (void)
+{
+  uint8_t *data;
+  size_t i;
+
+  data = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                              CACHE_SIZE * BLOCK_SECTOR_SIZE / PGSIZE);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      e->valid = false;
+      e->accessed = false;
+      e->pin_cnt = 0;
+      lock_init (&e->lock);
+      e->dirty = false;
+      e->data = data + i * BLOCK_SECTOR_SIZE;
+    }
+  lock_init (&cache_lock);
+  cond_init (&cache_unpinned);
+  clock_hand = 0;
+
+  lock_init (&read_ahead_lock);
+  cond_init (&read_ahead_ready);
+  read_ahead_head = read_ahead_cnt = 0;
+
+  thread_create ("write-behind", PRI_DEFAULT, write_behind_thread, NULL);
+  thread_create ("read-ahead", PRI_DEFAULT, read_ahead_thread, NULL);
+}
+
+/* Reads SIZE bytes starting at byte offset OFS within SECTOR
+   into BUFFER. */
+void
+cache_read (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e, false);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR starting at byte
+   offset OFS.  The sector reaches the disk later, when it is
+   evicted or flushed. */
+void
+cache_write (block_sector_t sector, const void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  /* A write that covers the whole sector need not read it first. */
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  cache_put (e, true);
+}
+
+/* Asks the read-ahead thread to bring SECTOR into the cache.
+   Returns immediately.  The request is dropped if too many are
+   already pending. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  lock_acquire (&read_ahead_lock);
+  if (read_ahead_cnt < READ_AHEAD_MAX)
+    {
+      read_ahead_queue[(read_ahead_head + read_ahead_cnt++)
+                       % READ_AHEAD_MAX] = sector;
+      cond_signal (&read_ahead_ready, &read_ahead_lock);
+    }
+  lock_release (&read_ahead_lock);
+}
+
+/* Writes every dirty sector in the cache back to disk.  Runs of
+   dirty entries for consecutive sectors, such as a newly zeroed
+   file or the free map, are written with a single request. */
+void
+cache_flush (void)
+{
+  struct cache_entry *dirty[CACHE_SIZE];
+  struct block_iovec iov[CACHE_SIZE];
+  size_t cnt, i, j, k;
+
+  /* Pin the dirty entries, sorted by sector.  Reading `dirty'
+     without an entry's lock is only a hint, but a sector
+     dirtied after we pass it will be caught by the next
+     flush. */
+  lock_acquire (&cache_lock);
+  for (i = cnt = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      if (!e->valid || !e->dirty)
+        continue;
+      e->pin_cnt++;
+      for (j = cnt++; j > 0 && dirty[j - 1]->sector > e->sector; j--)
+        dirty[j] = dirty[j - 1];
+      dirty[j] = e;
+    }
+  lock_release (&cache_lock);
+
+  /* Pinned entries keep their sectors, so the runs found here
+     stay valid.  Entry locks are taken in sector order, so
+     concurrent flushes cannot deadlock. */
+  for (i = 0; i < cnt; i = j)
+    {
+      for (j = i + 1; j < cnt && dirty[j]->sector == dirty[j - 1]->sector + 1;
+           j++)
+        continue;
+      for (k = i; k < j; k++)
+        {
+          lock_acquire (&dirty[k]->lock);
+          iov[k - i].buffer = dirty[k]->data;
+          iov[k - i].cnt = 1;
+        }
+      block_writev (fs_device, dirty[i]->sector, iov, j - i);
+      for (k = i; k < j; k++)
+        {
+          dirty[k]->dirty = false;
+          cache_put (dirty[k], false);
+        }
+    }
+}
+
+/* Returns the cache entry for SECTOR, pinned and with its lock
+   held, evicting another sector if necessary.  If LOAD is true,
+   the entry's data is read from disk on a miss; otherwise the
+   caller must overwrite all of it.  Release the entry with
+   cache_put(). */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool load)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      e = lookup (sector);
+      if (e != NULL)
+        {
+          e->pin_cnt++;
+          e->accessed = true;
+          lock_release (&cache_lock);
+
+          /* If the entry is still being read in, this waits for it. */
+          lock_acquire (&e->lock);
+          return e;
+        }
+
+      e = choose_victim ();
+      if (e == NULL)
+        {
+          /* Every entry is pinned.  Someone else may bring SECTOR
+             in while we wait, so look it up again afterward. */
+          cond_wait (&cache_unpinned, &cache_lock);
+          continue;
+        }
+      if (!e->valid || !e->dirty)
+        break;
+
+      /* Write back the old sector without holding cache_lock, so
+         that hits elsewhere in the cache do not wait for the
+         disk.  The entry keeps its old sector until the write is
+         done, so anyone who misses on that sector meanwhile finds
+         the entry instead of reading a stale copy from disk, and
+         our pin keeps it from being chosen as a victim again. */
+      e->pin_cnt++;
+      lock_release (&cache_lock);
+      lock_acquire (&e->lock);
+      if (e->dirty)
+        {
+          block_write (fs_device, e->sector, e->data);
+          e->dirty = false;
+        }
+      lock_release (&e->lock);
+      lock_acquire (&cache_lock);
+
+      /* The entry can be reused only if nobody started using its
+         old sector, which would have pinned it, and nobody else
+         brought SECTOR in.  Otherwise, start over. */
+      if (--e->pin_cnt == 0)
+        {
+          if (lookup (sector) == NULL)
+            break;
+          cond_signal (&cache_unpinned, &cache_lock);
+        }
+    }
+
+  /* Nobody else can be holding or waiting for the lock of an
+     unpinned entry, so this does not block.  Entries are dirtied
+     only while pinned, so E is still clean. */
+  lock_acquire (&e->lock);
+  ASSERT (!e->valid || !e->dirty);
+  e->sector = sector;
+  e->valid = true;
+  e->accessed = true;
+  e->pin_cnt = 1;
+  lock_release (&cache_lock);
+
+  if (load)
+    block_read (fs_device, sector, e->data);
+  return e;
+}
+
+/* Releases entry E obtained from cache_get(), marking it dirty
+   if DIRTY is true. */
+static void
+cache_put (struct cache_entry *e, bool dirty)
+{
+  if (dirty)
+    e->dirty = true;
+  lock_release (&e->lock);
+
+  lock_acquire (&cache_lock);
+  ASSERT (e->pin_cnt > 0);
+  if (--e->pin_cnt == 0)
+    cond_signal (&cache_unpinned, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Returns the entry caching SECTOR, or a null pointer if SECTOR
+   is not cached.  Must be called with cache_lock held. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Chooses an unpinned entry to reuse with the clock algorithm:
+   entries accessed since the hand last passed get a second
+   chance.  Returns a null pointer if every entry is pinned.
+   Must be called with cache_lock held. */
+static struct cache_entry *
+choose_victim (void)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (!e->valid)
+        return e;
+      if (e->pin_cnt > 0)
+        continue;
+      if (e->accessed)
+        e->accessed = false;
+      else
+        return e;
+    }
+  return NULL;
+}
+
+/* Periodically writes dirty sectors back to disk, so that a
+   crash loses at most WRITE_BEHIND_TICKS worth of writes. */
+static void
+write_behind_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (WRITE_BEHIND_TICKS);
+      cache_flush ();
+    }
+}
+
+/* Brings sectors queued by cache_read_ahead() into the cache. */
+static void
+read_ahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+      bool cached;
+
+      lock_acquire (&read_ahead_lock);
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_ready, &read_ahead_lock);
+      sector = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_MAX;
+      read_ahead_cnt--;
+      lock_release (&read_ahead_lock);
+
+      lock_acquire (&cache_lock);
+      cached = lookup (sector) != NULL;
+      lock_release (&cache_lock);
+
+      if (!cached)
+        cache_put (cache_get (sector, true), false);
+    }
+}
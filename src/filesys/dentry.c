@@ -0,0 +1,106 @@
+#include "filesys/dentry.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Directory entry cache.
+
+   Maps a directory's inode sector and a name in the directory to
+   the inode sector of the file by that name, or to 0 if the
+   directory is known to have no such file.  (Sector 0 holds the
+   free map inode, so it never names a file in a directory.)
+   Path resolution asks here before opening each directory along
+   the path, so a path whose components are all cached is
+   resolved without reading any directory.
+
+   The cache is direct-mapped: a (directory, name) pair has a
+   single slot, and a new entry replaces whatever was there.  The
+   directory module keeps the cache coherent by recording every
+   lookup result and every change it makes while holding the lock
+   of the directory concerned. */
+
+/* Number of cached entries. */
+#define DENTRY_CNT 512
+
+/* A cached name. */
+struct dentry
+  {
+    block_sector_t dir;                 /* Directory's inode sector. */
+    block_sector_t sector;              /* File's inode sector, or 0. */
+    char name[NAME_MAX + 1];            /* Name, or "" if slot unused. */
+  };
+
+static struct dentry *dentries;
+static struct lock dentry_lock;
+
+/* Returns the slot for NAME in the directory in sector DIR. */
+static struct dentry *
+slot_for (block_sector_t dir, const char *name)
+{
+  return &dentries[(hash_string (name) ^ hash_int (dir)) % DENTRY_CNT];
+}
+
+/* Initializes the directory entry cache. */
+void
+dentry_init (void)
+{
+  dentries = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                  DIV_ROUND_UP (DENTRY_CNT
+                                                * sizeof *dentries,
+                                                PGSIZE));
+  lock_init (&dentry_lock);
+}
+
+/* Looks up NAME in the directory in sector DIR.  If the cache
+   knows the answer, returns true and sets *SECTORP to the sector
+   of the file's inode, or to 0 if there is no such file.
+   Otherwise, returns false. */
+bool
+dentry_lookup (block_sector_t dir, const char *name, block_sector_t *sectorp)
+{
+  struct dentry *d = slot_for (dir, name);
+  bool found;
+
+  lock_acquire (&dentry_lock);
+  found = d->dir == dir && d->name[0] != '\0' && !strcmp (d->name, name);
+  if (found)
+    *sectorp = d->sector;
+  lock_release (&dentry_lock);
+  return found;
+}
+
+/* Records that NAME in the directory in sector DIR refers to the
+   inode in SECTOR, or that there is no such file if SECTOR is
+   0.  NAME is ignored if it is too long to cache. */
+void
+dentry_insert (block_sector_t dir, const char *name, block_sector_t sector)
+{
+  struct dentry *d = slot_for (dir, name);
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dentry_lock);
+  d->dir = dir;
+  d->sector = sector;
+  strlcpy (d->name, name, sizeof d->name);
+  lock_release (&dentry_lock);
+}
+
+/* Forgets every name cached for the directory in sector DIR. */
+void
+dentry_forget_dir (block_sector_t dir)
+{
+  size_t i;
+
+  lock_acquire (&dentry_lock);
+  for (i = 0; i < DENTRY_CNT; i++)
+    if (dentries[i].dir == dir)
+      dentries[i].name[0] = '\0';
+  lock_release (&dentry_lock);
+}
@@ -0,0 +1,12 @@
+#ifndef FILESYS_DENTRY_H
+#define FILESYS_DENTRY_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+void dentry_init (void);
+bool dentry_lookup (block_sector_t dir, const char *name, block_sector_t *);
+void dentry_insert (block_sector_t dir, const char *name, block_sector_t);
+void dentry_forget_dir (block_sector_t dir);
+
+#endif /* filesys/dentry.h */
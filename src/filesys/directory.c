@@ -1,52 +1,199 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/cache.h"
+#include "filesys/dentry.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
-/* A directory. */
-struct dir 
+/* A directory.
+
+   On disk, a directory is an extendible hash table of its
+   entries, keyed by hash_string() of the name.  Block 0 of the
+   directory's data is a `struct dir_header' whose bucket table
+   maps the low `depth' bits of a name's hash to the block that
+   holds the name.  Every other block is a `struct dir_block'.
+   A block with local depth D holds only names that agree on the
+   low D bits of their hashes, and is shared by the 2**(depth - D)
+   table slots that end in those bits.  When a block fills up it
+   is split in two by the next hash bit, doubling the table first
+   if necessary, so a lookup reads the header and a single block.
+   Once the table has MAX_DEPTH bits, full blocks are chained to
+   overflow blocks instead.  Blocks are never merged.
+
+   "." and ".." are not stored as entries: the header records the
+   parent directory's sector instead.
+
+   Lookups and updates of a directory's entries are serialized by
+   the directory lock in its inode, which all the `struct dir's
+   for the directory share. */
+struct dir
   {
     struct inode *inode;                /* Backing store. */
+    struct dir_cache *cache;            /* Shared in-memory state. */
     off_t pos;                          /* Current position. */
   };
 
 /* A single directory entry. */
-struct dir_entry 
+struct dir_entry
   {
     block_sector_t inode_sector;        /* Sector number of header. */
     char name[NAME_MAX + 1];            /* Null terminated file name. */
     bool in_use;                        /* In use or free? */
   };
 
+/* Identifies a hashed directory. */
+#define DIR_MAGIC 0x48524944
+
+/* Maximum number of hash bits used to select a bucket. */
+#define MAX_DEPTH 7
+
+/* Number of slots in the bucket table at MAX_DEPTH. */
+#define TABLE_SIZE (1 << MAX_DEPTH)
+
+/* Header, in block 0 of the directory.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct dir_header
+  {
+    unsigned magic;                     /* Magic number. */
+    uint32_t depth;                     /* Number of hash bits in use. */
+    block_sector_t parent;              /* Parent directory's sector. */
+    uint16_t buckets[TABLE_SIZE];       /* Bucket -> block number. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 12 - TABLE_SIZE * 2];
+  };
+
+/* Number of entries in a block. */
+#define ENTRIES_PER_BLOCK \
+        ((BLOCK_SECTOR_SIZE - 8) / sizeof (struct dir_entry))
+
+/* A block of entries.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct dir_block
+  {
+    uint32_t depth;                     /* Number of hash bits shared. */
+    uint32_t next;                      /* Overflow block, or 0. */
+    struct dir_entry entries[ENTRIES_PER_BLOCK];
+    uint8_t unused[BLOCK_SECTOR_SIZE - 8
+                   - ENTRIES_PER_BLOCK * sizeof (struct dir_entry)];
+  };
+
+/* In-memory state for an open directory, shared by all the
+   `struct dir's for it.
+
+   `elem', `inode' and `open_cnt' are protected by
+   open_dirs_lock.  The rest is protected by the directory lock:
+   `header' is a copy of the directory's header once `loaded' is
+   true.  Names are cached in the global dentry cache. */
+struct dir_cache
+  {
+    struct list_elem elem;              /* Element in open_dirs. */
+    struct inode *inode;                /* Directory's inode. */
+    int open_cnt;                       /* Number of `struct dir's. */
+    bool loaded;                        /* Is `header' valid? */
+    struct dir_header header;           /* Copy of on-disk header. */
+  };
+
+/* List of `struct dir_cache's for open directories. */
+static struct list open_dirs;
+static struct lock open_dirs_lock;
+
+static struct dir_cache *dir_cache_get (struct inode *);
+static void dir_cache_put (struct dir_cache *);
+
+/* Returns the byte offset of block IDX in a directory. */
+static inline off_t
+block_ofs (uint32_t idx)
+{
+  return idx * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the byte offset of entry SLOT of block IDX in a
+   directory. */
+static inline off_t
+entry_ofs (uint32_t idx, size_t slot)
+{
+  return (block_ofs (idx) + offsetof (struct dir_block, entries)
+          + slot * sizeof (struct dir_entry));
+}
+
+/* Initializes the directory module. */
+void
+dir_init (void)
+{
+  list_init (&open_dirs);
+  lock_init (&open_dirs_lock);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, whose parent is the directory in sector PARENT.
+   Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, size_t entry_cnt, block_sector_t parent)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_header *h;
+  struct dir_block *b;
+  struct inode *inode = NULL;
+  size_t depth, i;
+  bool success = false;
+
+  ASSERT (sizeof *h == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof *b == BLOCK_SECTOR_SIZE);
+
+  /* Start with enough buckets for ENTRY_CNT names. */
+  for (depth = 0; depth < MAX_DEPTH; depth++)
+    if ((ENTRIES_PER_BLOCK << depth) >= entry_cnt)
+      break;
+
+  h = calloc (1, sizeof *h);
+  b = calloc (1, sizeof *b);
+  if (h == NULL || b == NULL
+      || !inode_create (sector, block_ofs (1 + (1 << depth)), true))
+    goto done;
+  inode = inode_open (sector);
+  if (inode == NULL)
+    goto done;
+
+  h->magic = DIR_MAGIC;
+  h->depth = depth;
+  h->parent = parent;
+  b->depth = depth;
+  for (i = 0; i < (1u << depth); i++)
+    {
+      h->buckets[i] = 1 + i;
+      if (inode_write_at (inode, b, sizeof *b, block_ofs (1 + i))
+          != sizeof *b)
+        goto done;
+    }
+  success = inode_write_at (inode, h, sizeof *h, 0) == sizeof *h;
+
+ done:
+  inode_close (inode);
+  free (h);
+  free (b);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
    it takes ownership.  Returns a null pointer on failure. */
 struct dir *
-dir_open (struct inode *inode) 
+dir_open (struct inode *inode)
 {
   struct dir *dir = calloc (1, sizeof *dir);
   if (inode != NULL && dir != NULL)
     {
       dir->inode = inode;
+      dir->cache = dir_cache_get (inode);
       dir->pos = 0;
-      return dir;
-    }
-  else
-    {
-      inode_close (inode);
-      free (dir);
-      return NULL; 
+      if (dir->cache != NULL)
+        return dir;
     }
+  inode_close (inode);
+  free (dir);
+  return NULL;
 }
 
 /* Opens the root directory and returns a directory for it.
@@ -60,17 +207,18 @@ dir_open_root (void)
 /* Opens and returns a new directory for the same inode as DIR.
    Returns a null pointer on failure. */
 struct dir *
-dir_reopen (struct dir *dir) 
+dir_reopen (struct dir *dir)
 {
   return dir_open (inode_reopen (dir->inode));
 }
 
 /* Destroys DIR and frees associated resources. */
 void
-dir_close (struct dir *dir) 
+dir_close (struct dir *dir)
 {
   if (dir != NULL)
     {
+      dir_cache_put (dir->cache);
       inode_close (dir->inode);
       free (dir);
     }
@@ -78,60 +226,359 @@ dir_close (struct dir *dir)
 
 /* Returns the inode encapsulated by DIR. */
 struct inode *
-dir_get_inode (struct dir *dir) 
+dir_get_inode (struct dir *dir)
 {
   return dir->inode;
 }
 
-/* Searches DIR for a file with the given NAME.
+/* Returns the shared state for the directory in INODE, creating
+   it if INODE has none yet.  Returns a null pointer if memory
+   allocation fails. */
+static struct dir_cache *
+dir_cache_get (struct inode *inode)
+{
+  struct dir_cache *c;
+  struct list_elem *e;
+
+  lock_acquire (&open_dirs_lock);
+  for (e = list_begin (&open_dirs); e != list_end (&open_dirs);
+       e = list_next (e))
+    {
+      c = list_entry (e, struct dir_cache, elem);
+      if (c->inode == inode)
+        {
+          c->open_cnt++;
+          goto done;
+        }
+    }
+
+  c = calloc (1, sizeof *c);
+  if (c != NULL)
+    {
+      c->inode = inode;
+      c->open_cnt = 1;
+      c->loaded = false;
+      list_push_front (&open_dirs, &c->elem);
+    }
+
+ done:
+  lock_release (&open_dirs_lock);
+  return c;
+}
+
+/* Releases C, obtained from dir_cache_get(), and frees it if it
+   has no other users. */
+static void
+dir_cache_put (struct dir_cache *c)
+{
+  lock_acquire (&open_dirs_lock);
+  if (--c->open_cnt == 0)
+    {
+      list_remove (&c->elem);
+      free (c);
+    }
+  lock_release (&open_dirs_lock);
+}
+
+/* Returns DIR's header, reading it from disk if it has not been
+   read yet.  Returns a null pointer if DIR's header is
+   unreadable or DIR is not a hashed directory.  Must be called
+   with DIR's directory lock held. */
+static struct dir_header *
+get_header (const struct dir *dir)
+{
+  struct dir_cache *c = dir->cache;
+
+  if (!c->loaded)
+    {
+      if (inode_read_at (dir->inode, &c->header, sizeof c->header, 0)
+          != sizeof c->header
+          || c->header.magic != DIR_MAGIC)
+        return NULL;
+      c->loaded = true;
+    }
+  return &c->header;
+}
+
+/* Writes DIR's cached header back to disk.  Returns true if
+   successful, false on failure. */
+static bool
+put_header (const struct dir *dir)
+{
+  struct dir_header *h = &dir->cache->header;
+  return inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Reads block IDX of DIR into B.  Returns true if successful,
+   false on failure. */
+static bool
+read_block (const struct dir *dir, uint32_t idx, struct dir_block *b)
+{
+  return (inode_read_at (dir->inode, b, sizeof *b, block_ofs (idx))
+          == sizeof *b);
+}
+
+/* Writes B to block IDX of DIR, extending DIR if IDX is just
+   past its end.  Returns true if successful, false on
+   failure. */
+static bool
+write_block (struct dir *dir, uint32_t idx, const struct dir_block *b)
+{
+  return (inode_write_at (dir->inode, b, sizeof *b, block_ofs (idx))
+          == sizeof *b);
+}
+
+/* Returns the number of the first block of the bucket for names
+   with hash HASH in the directory with header H. */
+static uint32_t
+bucket_block (const struct dir_header *h, unsigned hash)
+{
+  return h->buckets[hash & ((1u << h->depth) - 1)];
+}
+
+/* Searches DIR for a file with the given NAME, whose hash is
+   HASH.  B must point to a block-sized buffer, which is
+   clobbered.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
    otherwise, returns false and ignores EP and OFSP. */
 static bool
-lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+lookup (const struct dir *dir, const char *name, unsigned hash,
+        struct dir_block *b, struct dir_entry *ep, off_t *ofsp)
 {
-  struct dir_entry e;
-  size_t ofs;
-  
+  struct dir_header *h;
+  uint32_t idx;
+  size_t i;
+
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
+  h = get_header (dir);
+  if (h == NULL)
+    return false;
+
+  for (idx = bucket_block (h, hash); idx != 0; idx = b->next)
+    {
+      if (!read_block (dir, idx, b))
+        return false;
+      for (i = 0; i < ENTRIES_PER_BLOCK; i++)
+        {
+          struct dir_entry *e = &b->entries[i];
+          if (e->in_use && !strcmp (name, e->name))
+            {
+              if (ep != NULL)
+                *ep = *e;
+              if (ofsp != NULL)
+                *ofsp = entry_ofs (idx, i);
+              return true;
+            }
+        }
+    }
   return false;
 }
 
+/* Sets *SECTORP to the sector of the inode for NAME in DIR,
+   consulting and filling in the dentry cache.  NAME may be "."
+   or "..".  Returns true if successful, false if DIR has no file
+   named NAME.  Must be called with DIR's directory lock held. */
+static bool
+lookup_sector (const struct dir *dir, const char *name,
+               block_sector_t *sectorp)
+{
+  block_sector_t sector = inode_get_inumber (dir->inode);
+  struct dir_header *h;
+  struct dir_block *b;
+  struct dir_entry e;
+
+  if (!strcmp (name, "."))
+    {
+      *sectorp = sector;
+      return true;
+    }
+  if (dentry_lookup (sector, name, sectorp))
+    return *sectorp != 0;
+
+  h = get_header (dir);
+  if (h == NULL)
+    return false;
+  if (!strcmp (name, ".."))
+    *sectorp = h->parent;
+  else
+    {
+      b = malloc (sizeof *b);
+      if (b == NULL)
+        return false;
+      *sectorp = lookup (dir, name, hash_string (name), b, &e, NULL)
+                 ? e.inode_sector : 0;
+      free (b);
+    }
+  dentry_insert (sector, name, *sectorp);
+  return *sectorp != 0;
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
    a null pointer.  The caller must close *INODE. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
-            struct inode **inode) 
+            struct inode **inode)
 {
-  struct dir_entry e;
+  block_sector_t sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  inode_dir_lock (dir->inode);
+  *inode = lookup_sector (dir, name, &sector) ? inode_open (sector) : NULL;
+  inode_dir_unlock (dir->inode);
 
   return *inode != NULL;
 }
 
+/* Looks up NAME, which may be "." or "..", in the directory
+   whose inode is in sector DIR_SECTOR, and sets *SECTORP to the
+   sector of the named file's inode.  Names in the dentry cache
+   are resolved without opening the directory.  Returns true if
+   successful, false if DIR_SECTOR is not a directory or has no
+   file named NAME. */
+bool
+dir_lookup_sector (block_sector_t dir_sector, const char *name,
+                   block_sector_t *sectorp)
+{
+  struct inode *inode;
+  struct dir *dir;
+  bool success;
+
+  if (!strcmp (name, "."))
+    {
+      *sectorp = dir_sector;
+      return true;
+    }
+  if (dentry_lookup (dir_sector, name, sectorp))
+    return *sectorp != 0;
+
+  inode = inode_open (dir_sector);
+  if (inode == NULL || !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return false;
+    }
+  dir = dir_open (inode);
+  if (dir == NULL)
+    return false;
+  inode_dir_lock (dir->inode);
+  success = lookup_sector (dir, name, sectorp);
+  inode_dir_unlock (dir->inode);
+  dir_close (dir);
+  return success;
+}
+
+/* Splits block IDX of DIR, which holds B, into two blocks by
+   the next bit of its names' hashes, doubling DIR's bucket table
+   first if the block is already distinguished by every bit the
+   table uses.  The block's depth must be less than MAX_DEPTH.
+   Returns true if successful, false on failure. */
+static bool
+split_block (struct dir *dir, uint32_t idx, struct dir_block *b)
+{
+  struct dir_header *h = &dir->cache->header;
+  struct dir_block *nb;
+  uint32_t new_idx, bit;
+  size_t i;
+  bool success = false;
+
+  ASSERT (b->depth < MAX_DEPTH);
+  ASSERT (b->next == 0);
+
+  nb = calloc (1, sizeof *nb);
+  if (nb == NULL)
+    return false;
+
+  /* Names whose next hash bit is set move to a new block at the
+     end of the directory. */
+  new_idx = inode_length (dir->inode) / BLOCK_SECTOR_SIZE;
+  bit = 1u << b->depth;
+  b->depth++;
+  nb->depth = b->depth;
+  for (i = 0; i < ENTRIES_PER_BLOCK; i++)
+    if (b->entries[i].in_use && (hash_string (b->entries[i].name) & bit))
+      {
+        nb->entries[i] = b->entries[i];
+        b->entries[i].in_use = false;
+      }
+  if (!write_block (dir, new_idx, nb) || !write_block (dir, idx, b))
+    goto done;
+
+  /* Point half of the block's buckets at the new block. */
+  if (b->depth > h->depth)
+    {
+      for (i = 0; i < (1u << h->depth); i++)
+        h->buckets[i + (1u << h->depth)] = h->buckets[i];
+      h->depth++;
+    }
+  for (i = 0; i < (1u << h->depth); i++)
+    if (h->buckets[i] == idx && (i & bit))
+      h->buckets[i] = new_idx;
+  success = put_header (dir);
+
+ done:
+  free (nb);
+  return success;
+}
+
+/* Stores E in a free slot of the bucket for names with hash
+   HASH in DIR, growing the bucket if it is full.  B must point
+   to a block-sized buffer, which is clobbered.  Returns true if
+   successful, false on failure. */
+static bool
+insert (struct dir *dir, const struct dir_entry *e, unsigned hash,
+        struct dir_block *b)
+{
+  struct dir_header *h = &dir->cache->header;
+  uint32_t first, idx;
+  size_t i;
+
+  for (;;)
+    {
+      /* Look for a free slot in the bucket. */
+      first = idx = bucket_block (h, hash);
+      for (;;)
+        {
+          if (!read_block (dir, idx, b))
+            return false;
+          for (i = 0; i < ENTRIES_PER_BLOCK; i++)
+            if (!b->entries[i].in_use)
+              return (inode_write_at (dir->inode, e, sizeof *e,
+                                      entry_ofs (idx, i)) == sizeof *e);
+          if (b->next == 0)
+            break;
+          idx = b->next;
+        }
+
+      /* The bucket is full.  Split it and try again, unless it
+         already uses every hash bit. */
+      if (b->depth < MAX_DEPTH)
+        {
+          ASSERT (idx == first);
+          if (!split_block (dir, idx, b))
+            return false;
+          continue;
+        }
+
+      /* Chain an overflow block holding just E. */
+      b->next = inode_length (dir->inode) / BLOCK_SECTOR_SIZE;
+      if (!write_block (dir, idx, b))
+        return false;
+      idx = b->next;
+      memset (b, 0, sizeof *b);
+      b->depth = MAX_DEPTH;
+      b->entries[0] = *e;
+      return write_block (dir, idx, b);
+    }
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
@@ -141,59 +588,105 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_block *b;
   struct dir_entry e;
-  off_t ofs;
+  unsigned hash;
   bool success = false;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
   /* Check NAME for validity. */
-  if (*name == '\0' || strlen (name) > NAME_MAX)
+  if (*name == '\0' || strlen (name) > NAME_MAX
+      || !strcmp (name, ".") || !strcmp (name, ".."))
     return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
-    goto done;
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  /* Check that NAME is not in use and that DIR has not been
+     removed. */
+  hash = hash_string (name);
+  inode_dir_lock (dir->inode);
+  if (inode_is_removed (dir->inode) || get_header (dir) == NULL
+      || lookup (dir, name, hash, b, NULL, NULL))
+    goto done;
 
   /* Write slot. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  success = insert (dir, &e, hash, b);
+  if (success)
+    {
+      /* INODE_SECTOR may once have held a directory, whose
+         names must not be found in the new file. */
+      dentry_forget_dir (inode_sector);
+      dentry_insert (inode_get_inumber (dir->inode), name, inode_sector);
+    }
 
  done:
+  inode_dir_unlock (dir->inode);
+  free (b);
   return success;
 }
 
+/* Marks the directory in INODE removed if it has no entries.
+   B must point to a block-sized buffer, which is clobbered.
+   Returns true if successful, false if the directory is not
+   empty or cannot be read. */
+static bool
+remove_empty_dir (struct inode *inode, struct dir_block *b)
+{
+  uint32_t idx, block_cnt;
+  bool empty = true;
+  size_t i;
+
+  /* Holding the lock keeps files from being added until the
+     directory is marked removed, after which dir_add() refuses
+     them. */
+  inode_dir_lock (inode);
+  block_cnt = inode_length (inode) / BLOCK_SECTOR_SIZE;
+  for (idx = 1; idx < block_cnt && empty; idx++)
+    {
+      if (inode_read_at (inode, b, sizeof *b, block_ofs (idx)) != sizeof *b)
+        empty = false;
+      for (i = 0; i < ENTRIES_PER_BLOCK && empty; i++)
+        if (b->entries[i].in_use)
+          empty = false;
+    }
+  if (empty)
+    inode_remove (inode);
+  inode_dir_unlock (inode);
+  return empty;
+}
+
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs if there is no file with the given NAME or if
+   NAME is a directory that is not empty. */
 bool
-dir_remove (struct dir *dir, const char *name) 
+dir_remove (struct dir *dir, const char *name)
 {
+  struct dir_block *b;
   struct dir_entry e;
   struct inode *inode = NULL;
+  unsigned hash;
   bool success = false;
   off_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  hash = hash_string (name);
+  inode_dir_lock (dir->inode);
+  if (!lookup (dir, name, hash, b, &e, &ofs))
     goto done;
 
   /* Open inode. */
@@ -201,36 +694,134 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* A directory must be empty to be removed. */
+  if (inode_is_dir (inode) && !remove_empty_dir (inode, b))
+    goto done;
+
   /* Erase directory entry. */
   e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
     goto done;
+  dentry_insert (inode_get_inumber (dir->inode), name, 0);
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  inode_dir_unlock (dir->inode);
   inode_close (inode);
+  free (b);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.
+
+   Entries are returned in block order.  A name added while DIR
+   is being read may cause a block to split, so that names
+   already returned are moved to a later block and returned
+   again. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool found = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  inode_dir_lock (dir->inode);
+  for (;;)
     {
-      dir->pos += sizeof e;
+      uint32_t idx = 1 + dir->pos / ENTRIES_PER_BLOCK;
+      size_t slot = dir->pos % ENTRIES_PER_BLOCK;
+
+      if (inode_read_at (dir->inode, &e, sizeof e, entry_ofs (idx, slot))
+          != sizeof e)
+        break;
+      dir->pos++;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
-        } 
+          found = true;
+          break;
+        }
     }
-  return false;
+  inode_dir_unlock (dir->inode);
+  return found;
+}
+
+/* Reads up to CNT entries from DIR, starting at its current
+   position, into INFO, and advances the position past them.
+   Returns the number of entries read, which is 0 at the end of
+   the directory.
+
+   Each block of entries is read once, and the inodes of the
+   entries found are read ahead together before any is opened,
+   so that listing a large directory does not wait on the disk
+   once per entry. */
+size_t
+dir_read_entries (struct dir *dir, struct dir_info *info, size_t cnt)
+{
+  struct dir_block *b;
+  size_t n = 0;
+  size_t i;
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return 0;
+
+  /* Holding the lock until the inodes are open keeps the entries'
+     files from being removed and their sectors reused. */
+  inode_dir_lock (dir->inode);
+  while (n < cnt)
+    {
+      uint32_t idx = 1 + dir->pos / ENTRIES_PER_BLOCK;
+      size_t slot = dir->pos % ENTRIES_PER_BLOCK;
+
+      if (!read_block (dir, idx, b))
+        break;
+      for (; slot < ENTRIES_PER_BLOCK && n < cnt; slot++)
+        {
+          struct dir_entry *e = &b->entries[slot];
+          dir->pos++;
+          if (e->in_use)
+            {
+              strlcpy (info[n].name, e->name, sizeof info[n].name);
+              info[n].inode_sector = e->inode_sector;
+              n++;
+            }
+        }
+    }
+
+  for (i = 0; i < n; i++)
+    cache_read_ahead (info[i].inode_sector);
+  for (i = 0; i < n; i++)
+    {
+      struct inode *inode = inode_open (info[i].inode_sector);
+      info[i].is_dir = inode != NULL && inode_is_dir (inode);
+      info[i].length = inode != NULL ? inode_length (inode) : 0;
+      inode_close (inode);
+    }
+  inode_dir_unlock (dir->inode);
+
+  free (b);
+  return n;
+}
+
+/* Sets DIR's position, as reported by dir_tell(), to POS. */
+void
+dir_seek (struct dir *dir, off_t pos)
+{
+  ASSERT (dir != NULL);
+  ASSERT (pos >= 0);
+  dir->pos = pos;
+}
+
+/* Returns the position of the next entry that dir_readdir() will
+   read from DIR. */
+off_t
+dir_tell (struct dir *dir)
+{
+  ASSERT (dir != NULL);
+  return dir->pos;
 }
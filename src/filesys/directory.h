@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "devices/block.h"
+#include "filesys/off_t.h"
 
 /* Maximum length of a file name component.
    This is the traditional UNIX maximum length.
@@ -13,8 +14,20 @@
 
 struct inode;
 
+/* Information about a directory entry, filled in by
+   dir_read_entries(). */
+struct dir_info
+  {
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    block_sector_t inode_sector;        /* Sector of the file's inode. */
+    bool is_dir;                        /* Is the file a directory? */
+    off_t length;                       /* File size in bytes. */
+  };
+
 /* Opening and closing directories. */
-bool dir_create (block_sector_t sector, size_t entry_cnt);
+void dir_init (void);
+bool dir_create (block_sector_t sector, size_t entry_cnt,
+                 block_sector_t parent);
 struct dir *dir_open (struct inode *);
 struct dir *dir_open_root (void);
 struct dir *dir_reopen (struct dir *);
@@ -23,8 +36,12 @@ struct inode *dir_get_inode (struct dir *);
 
 /* Reading and writing. */
 bool dir_lookup (const struct dir *, const char *name, struct inode **);
+bool dir_lookup_sector (block_sector_t, const char *name, block_sector_t *);
 bool dir_add (struct dir *, const char *name, block_sector_t);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+size_t dir_read_entries (struct dir *, struct dir_info *, size_t cnt);
+void dir_seek (struct dir *, off_t);
+off_t dir_tell (struct dir *);
 
 #endif /* filesys/directory.h */
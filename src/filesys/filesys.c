@@ -2,10 +2,14 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dentry.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -21,7 +25,10 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
   inode_init ();
+  dir_init ();
+  dentry_init ();
   free_map_init ();
 
   if (format) 
@@ -36,8 +43,133 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+
+  /* A kernel panic shuts down with interrupts off, when the disk
+     cannot be used and cached data may be inconsistent anyway. */
+  if (intr_get_level () == INTR_ON)
+    cache_flush ();
 }
 
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX character from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0')
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++;
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Resolves PATH, relative to the current thread's working
+   directory unless it starts with "/".  Opens and returns the
+   directory that holds PATH's last component, which is copied
+   into NAME.  If PATH names the root directory, returns the root
+   directory and sets NAME to ".".  Returns a null pointer if
+   PATH is empty, has a component that is too long, or passes
+   through a file or directory that does not exist.
+
+   Directories along the way are looked up through the dentry
+   cache, so only the last one is normally opened. */
+static struct dir *
+resolve (const char *path, char name[NAME_MAX + 1])
+{
+  struct dir *cwd = thread_current ()->cwd;
+  char next[NAME_MAX + 1];
+  block_sector_t sector;
+  struct inode *inode;
+  int result;
+
+  if (*path == '\0')
+    return NULL;
+  if (*path == '/' || cwd == NULL)
+    sector = ROOT_DIR_SECTOR;
+  else
+    sector = inode_get_inumber (dir_get_inode (cwd));
+
+  result = get_next_part (name, &path);
+  if (result < 0)
+    return NULL;
+  else if (result == 0)
+    strlcpy (name, ".", NAME_MAX + 1);
+  while ((result = get_next_part (next, &path)) > 0)
+    {
+      if (!dir_lookup_sector (sector, name, &sector))
+        return NULL;
+      strlcpy (name, next, NAME_MAX + 1);
+    }
+  if (result < 0)
+    return NULL;
+
+  inode = inode_open (sector);
+  if (inode == NULL || !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return NULL;
+    }
+  return dir_open (inode);
+}
+
+/* Creates a file named NAME with the given INITIAL_SIZE, or an
+   empty directory named NAME if IS_DIR is true.  Returns true if
+   successful, false otherwise. */
+static bool
+create (const char *name, off_t initial_size, bool is_dir)
+{
+  char base[NAME_MAX + 1];
+  block_sector_t inode_sector = 0;
+  struct dir *dir = resolve (name, base);
+  bool created = false;
+  bool success = false;
+
+  if (dir != NULL && free_map_allocate (1, &inode_sector))
+    {
+      if (is_dir)
+        created = dir_create (inode_sector, 0,
+                              inode_get_inumber (dir_get_inode (dir)));
+      else
+        created = inode_create (inode_sector, initial_size, false);
+      success = created && dir_add (dir, base, inode_sector);
+    }
+  if (!success && inode_sector != 0)
+    {
+      /* Removing the inode frees its data blocks, too. */
+      struct inode *inode = created ? inode_open (inode_sector) : NULL;
+      if (inode != NULL)
+        {
+          inode_remove (inode);
+          inode_close (inode);
+        }
+      else
+        free_map_release (inode_sector, 1);
+    }
+  dir_close (dir);
+
+  return success;
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
@@ -45,20 +177,20 @@ filesys_done (void)
 bool
 filesys_create (const char *name, off_t initial_size) 
 {
-  block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
-  if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
-  dir_close (dir);
+  return create (name, initial_size, false);
+}
 
-  return success;
+/* Creates an empty directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name)
+{
+  return create (name, 0, true);
 }
 
-/* Opens the file with the given NAME.
+/* Opens the file with the given NAME, which may be a directory.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
@@ -66,11 +198,12 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char base[NAME_MAX + 1];
+  struct dir *dir = resolve (name, base);
   struct inode *inode = NULL;
 
   if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+    dir_lookup (dir, base, &inode);
   dir_close (dir);
 
   return file_open (inode);
@@ -78,25 +211,55 @@ filesys_open (const char *name)
 
 /* Deletes the file named NAME.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
+   Fails if no file named NAME exists, if NAME is a directory
+   that is not empty,
    or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char base[NAME_MAX + 1];
+  struct dir *dir = resolve (name, base);
+  bool success = dir != NULL && dir_remove (dir, base);
   dir_close (dir); 
 
   return success;
 }
-
+
+/* Makes the directory named NAME the current thread's working
+   directory.  Returns true if successful, false if NAME does not
+   exist or is not a directory. */
+bool
+filesys_chdir (const char *name)
+{
+  struct thread *t = thread_current ();
+  char base[NAME_MAX + 1];
+  struct dir *dir = resolve (name, base);
+  struct inode *inode = NULL;
+
+  if (dir != NULL)
+    dir_lookup (dir, base, &inode);
+  dir_close (dir);
+
+  if (inode == NULL || !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return false;
+    }
+  dir = dir_open (inode);
+  if (dir == NULL)
+    return false;
+  dir_close (t->cwd);
+  t->cwd = dir;
+  return true;
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, 16, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
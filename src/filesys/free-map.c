@@ -4,14 +4,18 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static size_t alloc_hint;            /* Where the next search starts. */
+static struct lock free_map_lock;    /* Protects the free map. */
 
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
+  lock_init (&free_map_lock);
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
@@ -23,11 +27,20 @@ free_map_init (void)
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
-   written. */
+   written.
+
+   The search starts just past the previous allocation, so that
+   sectors allocated one at a time as a file grows tend to end
+   up next to each other on disk. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan_and_flip (free_map, alloc_hint, cnt, false);
+  if (sector == BITMAP_ERROR && alloc_hint != 0)
+    sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
   if (sector != BITMAP_ERROR
       && free_map_file != NULL
       && !bitmap_write (free_map, free_map_file))
@@ -36,7 +49,11 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
       sector = BITMAP_ERROR;
     }
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+    {
+      *sectorp = sector;
+      alloc_hint = sector + cnt;
+    }
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
@@ -44,9 +61,11 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
   bitmap_write (free_map, free_map_file);
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -73,7 +92,7 @@ void
 free_map_create (void) 
 {
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -67,6 +68,19 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Writes the ustar end-of-archive marker, two sectors of zeros,
+   to BLOCK at SECTOR in a single request, taking the zeros from
+   ZEROS, a BLOCK_SECTOR_SIZE buffer. */
+static void
+write_zero_sectors (struct block *block, block_sector_t sector, void *zeros)
+{
+  struct block_iovec iov[2];
+
+  iov[0].buffer = iov[1].buffer = zeros;
+  iov[0].cnt = iov[1].cnt = 1;
+  block_writev (block, sector, iov, 2);
+}
+
 /* Extracts a ustar-format tar archive from the scratch block
    device into the Pintos file system. */
 void
@@ -77,9 +91,9 @@ fsutil_extract (char **argv UNUSED)
   struct block *src;
   void *header, *data;
 
-  /* Allocate buffers. */
+  /* Allocate buffers.  File data is read a page at a time. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
+  data = palloc_get_page (0);
   if (header == NULL || data == NULL)
     PANIC ("couldn't allocate buffers");
 
@@ -127,10 +141,11 @@ fsutil_extract (char **argv UNUSED)
           /* Do copy. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
-                                : size);
-              block_read (src, sector++, data);
+              int chunk_size = size > PGSIZE ? PGSIZE : size;
+              block_sector_t chunk_sectors = DIV_ROUND_UP (chunk_size,
+                                                           BLOCK_SECTOR_SIZE);
+              block_read_multiple (src, sector, chunk_sectors, data);
+              sector += chunk_sectors;
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
@@ -148,10 +163,9 @@ fsutil_extract (char **argv UNUSED)
      end-of-archive marker. */
   printf ("Erasing ustar archive...\n");
   memset (header, 0, BLOCK_SECTOR_SIZE);
-  block_write (src, 0, header);
-  block_write (src, 1, header);
+  write_zero_sectors (src, 0, header);
 
-  free (data);
+  palloc_free_page (data);
   free (header);
 }
 
@@ -214,8 +228,7 @@ fsutil_append (char **argv)
      sectors full of zeros.  Don't advance our position past
      them, though, in case we have more files to append. */
   memset (buffer, 0, BLOCK_SECTOR_SIZE);
-  block_write (dst, sector, buffer);
-  block_write (dst, sector + 1, buffer);
+  write_zero_sectors (dst, sector, buffer);
 
   /* Finish up. */
   file_close (src);
@@ -1,23 +1,44 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of data sectors addressed directly by the inode. */
+#define DIRECT_CNT 123
+
+/* Number of sector numbers in an indirect block. */
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Maximum number of data sectors in a file. */
+#define MAX_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR \
+                     + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   Data sectors are found through a Unix-style index: the first
+   DIRECT_CNT sectors are listed in the inode itself, the next
+   PTRS_PER_SECTOR in the indirect block, and the rest through
+   the doubly indirect block, which lists indirect blocks.  A
+   sector number of 0 means "not allocated", since sector 0
+   always holds the free map inode. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+    block_sector_t indirect;            /* Indirect block. */
+    block_sector_t doubly_indirect;     /* Doubly indirect block. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t is_dir;                    /* Nonzero for a directory. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,49 +49,310 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+
+   `elem' and `open_cnt' are protected by the lock of the open
+   inode table shard that holds the inode.  `removed' and
+   `deny_write_cnt' are protected by the inode's own lock.
+
+   `rw' protects the file's size and layout: reads and writes
+   within the file hold it for reading, so they proceed in
+   parallel (the buffer cache keeps each sector consistent),
+   while a write that extends the file holds it for writing.
+   `dir_lock' is not used by this module; it serializes
+   operations on the directory, if the inode is one. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open inode table. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
+    struct lock lock;                   /* Protects the members below. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rw_lock rw;                  /* Protects data. */
+    struct lock dir_lock;               /* Directory lock. */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Allocates a sector, fills it with zeros, and stores its number
+   in *SECTORP.  Returns false if the disk is full. */
+static bool
+allocate_zeroed (block_sector_t *sectorp)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (!free_map_allocate (1, sectorp))
+    return false;
+  cache_write (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Returns the sector number in slot IDX of indirect block
+   INDIRECT.  If the slot is empty and ALLOCATE is true, first
+   fills it with a newly allocated, zeroed sector.  Returns 0 if
+   the slot is empty and allocation was not requested or
+   failed. */
+static block_sector_t
+indirect_get (block_sector_t indirect, size_t idx, bool allocate)
+{
+  block_sector_t sector;
+
+  cache_read (indirect, &sector, idx * sizeof sector, sizeof sector);
+  if (sector == 0 && allocate && allocate_zeroed (&sector))
+    cache_write (indirect, &sector, idx * sizeof sector, sizeof sector);
+  return sector;
+}
+
+/* Returns the sector that holds data sector IDX of the file
+   described by DISK_INODE, or 0 if that sector has not been
+   allocated.
+
+   The lookup touches at most two indirect blocks, which
+   normally stay in the buffer cache, so the cost is constant
+   regardless of file size. */
+static block_sector_t
+index_to_sector (const struct inode_disk *disk_inode, size_t idx)
+{
+  block_sector_t indirect;
+
+  if (idx < DIRECT_CNT)
+    return disk_inode->direct[idx];
+
+  idx -= DIRECT_CNT;
+  if (idx < PTRS_PER_SECTOR)
+    {
+      if (disk_inode->indirect == 0)
+        return 0;
+      return indirect_get (disk_inode->indirect, idx, false);
+    }
+
+  idx -= PTRS_PER_SECTOR;
+  if (idx < PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+    {
+      if (disk_inode->doubly_indirect == 0)
+        return 0;
+      indirect = indirect_get (disk_inode->doubly_indirect,
+                               idx / PTRS_PER_SECTOR, false);
+      if (indirect == 0)
+        return 0;
+      return indirect_get (indirect, idx % PTRS_PER_SECTOR, false);
+    }
+
+  return 0;
+}
+
+/* Stores SECTOR as data sector IDX of the file described by
+   DISK_INODE, first allocating any indirect blocks needed to
+   reach it.  Returns false if the disk is full. */
+static bool
+index_set (struct inode_disk *disk_inode, size_t idx, block_sector_t sector)
+{
+  block_sector_t indirect;
+
+  if (idx < DIRECT_CNT)
+    {
+      disk_inode->direct[idx] = sector;
+      return true;
+    }
+
+  idx -= DIRECT_CNT;
+  if (idx < PTRS_PER_SECTOR)
+    indirect = disk_inode->indirect;
+  else
+    {
+      idx -= PTRS_PER_SECTOR;
+      ASSERT (idx < PTRS_PER_SECTOR * PTRS_PER_SECTOR);
+      if (disk_inode->doubly_indirect == 0
+          && !allocate_zeroed (&disk_inode->doubly_indirect))
+        return false;
+      indirect = indirect_get (disk_inode->doubly_indirect,
+                               idx / PTRS_PER_SECTOR, true);
+      if (indirect == 0)
+        return false;
+      idx %= PTRS_PER_SECTOR;
+    }
+  if (indirect == 0)
+    {
+      if (!allocate_zeroed (&disk_inode->indirect))
+        return false;
+      indirect = disk_inode->indirect;
+    }
+  cache_write (indirect, &sector, idx * sizeof sector, sizeof sector);
+  return true;
+}
+
+/* Allocates zeroed data sectors so that DISK_INODE can hold
+   LENGTH bytes.  Does not change DISK_INODE's length.
+
+   Sectors are taken from the free map in runs as long as the
+   free map can supply, down to single sectors when free space is
+   fragmented, so that each run costs one write of the free map
+   instead of one per sector, and the new data tends to be
+   contiguous on disk.  Sectors past the current length that an
+   earlier failed extension left allocated are reused.
+
+   Returns false if the file would be too large or the disk is
+   full, in which case some sectors may have been allocated
+   anyway; they are released along with the rest of the file. */
+static bool
+extend (struct inode_disk *disk_inode, off_t length)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  size_t sectors = bytes_to_sectors (length);
+  size_t i, cnt, j;
+  block_sector_t start;
+
+  if (sectors > MAX_SECTORS)
+    return false;
+  for (i = bytes_to_sectors (disk_inode->length); i < sectors; i += cnt)
+    {
+      /* Count the unallocated sectors starting at I. */
+      for (cnt = 0; i + cnt < sectors; cnt++)
+        if (index_to_sector (disk_inode, i + cnt) != 0)
+          break;
+      if (cnt == 0)
+        {
+          cnt = 1;
+          continue;
+        }
+
+      /* Allocate as long a run as possible. */
+      while (!free_map_allocate (cnt, &start))
+        if ((cnt /= 2) == 0)
+          return false;
+
+      for (j = 0; j < cnt; j++)
+        {
+          cache_write (start + j, zeros, 0, BLOCK_SECTOR_SIZE);
+          if (!index_set (disk_inode, i + j, start + j))
+            {
+              free_map_release (start + j, cnt - j);
+              return false;
+            }
+        }
+    }
+  return true;
+}
+
+/* Releases SECTOR, which is an indirect block if LEVEL is 1, a
+   doubly indirect block if LEVEL is 2, or a data sector if LEVEL
+   is 0, and all the sectors it refers to. */
+static void
+release_tree (block_sector_t sector, int level)
+{
+  if (sector == 0)
+    return;
+
+  if (level > 0)
+    {
+      block_sector_t *ptrs = malloc (BLOCK_SECTOR_SIZE);
+      size_t i;
+
+      if (ptrs == NULL)
+        PANIC ("out of memory releasing inode blocks");
+      cache_read (sector, ptrs, 0, BLOCK_SECTOR_SIZE);
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        release_tree (ptrs[i], level - 1);
+      free (ptrs);
+    }
+  free_map_release (sector, 1);
+}
+
+/* Releases all the data and indirect blocks of DISK_INODE. */
+static void
+release_blocks (struct inode_disk *disk_inode)
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    release_tree (disk_inode->direct[i], 0);
+  release_tree (disk_inode->indirect, 1);
+  release_tree (disk_inode->doubly_indirect, 2);
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
+   Returns 0 if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
   if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+    return index_to_sector (&inode->data, pos / BLOCK_SECTOR_SIZE);
   else
-    return -1;
+    return 0;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Number of independently locked parts of the open inode
+   table. */
+#define SHARD_CNT 16
+
+/* Table of open inodes, so that opening a single inode twice
+   returns the same `struct inode'.  The table is split by sector
+   number into SHARD_CNT hash tables, each with its own lock, so
+   that opening and closing unrelated inodes seldom contend. */
+struct inode_shard
+  {
+    struct lock lock;                   /* Protects `inodes'. */
+    struct hash inodes;                 /* Open inodes, keyed by sector. */
+  };
+
+static struct inode_shard open_inodes[SHARD_CNT];
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  size_t i;
+
+  for (i = 0; i < SHARD_CNT; i++)
+    {
+      lock_init (&open_inodes[i].lock);
+      if (!hash_init (&open_inodes[i].inodes, inode_hash, inode_less, NULL))
+        PANIC ("out of memory creating open inode table");
+    }
+}
+
+/* Returns the open inode table shard that holds SECTOR.  The
+   shard is chosen from the top bits of the hash, because a hash
+   table picks buckets from the low bits: choosing by the low bits
+   too would give all of a shard's inodes the same low bits and
+   crowd them into a few of its buckets. */
+static struct inode_shard *
+shard_for (block_sector_t sector)
+{
+  return &open_inodes[(hash_int (sector) >> 24) % SHARD_CNT];
+}
+
+/* Returns a hash value for the inode containing E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode *inode = hash_entry (e, struct inode, elem);
+  return hash_int (inode->sector);
+}
+
+/* Returns true if the inode containing A precedes the one
+   containing B. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The inode is a directory if IS_DIR is true.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -84,22 +366,17 @@ inode_create (block_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
+      disk_inode->length = 0;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      disk_inode->is_dir = is_dir;
+      if (extend (disk_inode, length)) 
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
+          disk_inode->length = length;
+          cache_write (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
           success = true; 
         } 
+      else
+        release_blocks (disk_inode);
       free (disk_inode);
     }
   return success;
@@ -111,33 +388,43 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode_shard *shard = shard_for (sector);
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  lock_acquire (&shard->lock);
+  key.sector = sector;
+  e = hash_find (&shard->inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      lock_release (&shard->lock);
+      return inode;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&shard->lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  The shard stays locked until the inode is read
+     in, so that nobody else can find it half-initialized. */
   inode->sector = sector;
   inode->open_cnt = 1;
+  lock_init (&inode->lock);
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  rw_lock_init (&inode->rw);
+  lock_init (&inode->dir_lock);
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  hash_insert (&shard->inodes, &inode->elem);
+  lock_release (&shard->lock);
   return inode;
 }
 
@@ -146,7 +433,13 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      struct inode_shard *shard = shard_for (inode->sector);
+
+      lock_acquire (&shard->lock);
+      inode->open_cnt++;
+      lock_release (&shard->lock);
+    }
   return inode;
 }
 
@@ -163,22 +456,31 @@ inode_get_inumber (const struct inode *inode)
 void
 inode_close (struct inode *inode) 
 {
+  struct inode_shard *shard;
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
+  /* Remove from the open inode table if this was the last
+     opener.  Once it is out of the table, nobody else can reach
+     the inode, so the rest needs no locking. */
+  shard = shard_for (inode->sector);
+  lock_acquire (&shard->lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    hash_delete (&shard->inodes, &inode->elem);
+  lock_release (&shard->lock);
+
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          release_blocks (&inode->data);
         }
 
       free (inode); 
@@ -191,7 +493,21 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&inode->lock);
   inode->removed = true;
+  lock_release (&inode->lock);
+}
+
+/* Returns true if INODE has been removed, false otherwise. */
+bool
+inode_is_removed (struct inode *inode)
+{
+  bool removed;
+
+  lock_acquire (&inode->lock);
+  removed = inode->removed;
+  lock_release (&inode->lock);
+  return removed;
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -202,8 +518,10 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  off_t length;
 
+  rw_lock_acquire_read (&inode->rw);
+  length = inode->data.length;
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -211,7 +529,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -220,59 +538,87 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+
+  /* Sequential readers will most likely want the next sector
+     soon, so start bringing it in. */
+  if (bytes_read > 0)
+    {
+      off_t next = ROUND_UP (offset, BLOCK_SECTOR_SIZE);
+      if (next < length)
+        cache_read_ahead (byte_to_sector (inode, next));
+    }
+  rw_lock_release_read (&inode->rw);
 
   return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   A write past end of file extends the inode, filling any gap
+   with zeros.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the file cannot grow or an error occurs. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  off_t length;
+  bool exclusive = false;
 
+  lock_acquire (&inode->lock);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      lock_release (&inode->lock);
+      return 0;
+    }
+  lock_release (&inode->lock);
+
+  /* Writes within the file share the lock.  A write that ends
+     past end of file needs it exclusively, and has to check the
+     length again after upgrading since another writer may have
+     extended the file in between. */
+  rw_lock_acquire_read (&inode->rw);
+  length = inode->data.length;
+  if (offset + size > length)
+    {
+      rw_lock_release_read (&inode->rw);
+      rw_lock_acquire_write (&inode->rw);
+      exclusive = true;
+      length = inode->data.length;
+    }
+
+  /* Grow the file first if the write ends past its end.  The new
+     length takes effect only once the data is in place, so that
+     readers never see the file extended with unwritten data. */
+  if (offset + size > length)
+    {
+      bool extended = extend (&inode->data, offset + size);
+      cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+      if (!extended)
+        {
+          rw_lock_release_write (&inode->rw);
+          return 0;
+        }
+      length = offset + size;
+    }
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = index_to_sector (&inode->data,
+                                                   offset / BLOCK_SECTOR_SIZE);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -281,38 +627,25 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      cache_write (sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  if (exclusive)
+    {
+      if (length > inode->data.length)
+        {
+          inode->data.length = length;
+          cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+        }
+      rw_lock_release_write (&inode->rw);
+    }
+  else
+    rw_lock_release_read (&inode->rw);
 
   return bytes_written;
 }
@@ -322,8 +655,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +667,26 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&inode->lock);
+}
+
+/* Acquires the directory lock of INODE, which serializes
+   lookups and updates of the directory stored in INODE. */
+void
+inode_dir_lock (struct inode *inode)
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases the directory lock of INODE. */
+void
+inode_dir_unlock (struct inode *inode)
+{
+  lock_release (&inode->dir_lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -343,3 +695,10 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Returns true if INODE is a directory, false otherwise. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->data.is_dir != 0;
+}
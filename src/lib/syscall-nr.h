@@ -31,7 +31,12 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_PROCSTAT,               /* Get a process's CPU accounting. */
+    SYS_GETDENTS,               /* Reads many directory entries. */
+    SYS_UPTIME                  /* Timer ticks since boot. */
   };
 
 #endif /* lib/syscall-nr.h */
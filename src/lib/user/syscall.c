@@ -197,3 +197,21 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+procstat (pid_t pid, struct procstat *stat)
+{
+  return syscall2 (SYS_PROCSTAT, pid, stat);
+}
+
+int
+getdents (int fd, struct dirent *entries, unsigned cnt)
+{
+  return syscall3 (SYS_GETDENTS, fd, entries, cnt);
+}
+
+int
+uptime (void)
+{
+  return syscall0 (SYS_UPTIME);
+}
@@ -15,6 +15,26 @@ typedef int mapid_t;
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* CPU accounting for a process, filled in by procstat(). */
+struct procstat
+  {
+    long long user_ticks;               /* Timer ticks in user mode. */
+    long long kernel_ticks;             /* Timer ticks in the kernel. */
+    unsigned voluntary_switches;        /* Times it blocked or yielded. */
+    unsigned involuntary_switches;      /* Times it was preempted. */
+    long long wait_ticks;               /* Ticks spent ready to run. */
+    long long max_wait_ticks;           /* Longest wait to run. */
+  };
+
+/* A directory entry, filled in by getdents(). */
+struct dirent
+  {
+    int inumber;                        /* Inode number. */
+    int size;                           /* Size in bytes. */
+    bool is_dir;                        /* Is it a directory? */
+    char name[READDIR_MAX_LEN + 1];     /* Null-terminated name. */
+  };
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -51,4 +71,9 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+bool procstat (pid_t, struct procstat *);
+int getdents (int fd, struct dirent *, unsigned cnt);
+int uptime (void);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,39 @@
+/* Child process for syn-contend tests.
+   Grows its own test file one chunk at a time, while the other
+   children do the same to their files. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/syn-contend.h"
+
+static char buf[FILE_SIZE];
+
+int
+main (int argc, char *argv[])
+{
+  char file_name[16];
+  int child_idx;
+  int fd;
+  size_t i;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  snprintf (file_name, sizeof file_name, "contend%d", child_idx);
+
+  random_init (child_idx);
+  random_bytes (buf, sizeof buf);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (i = 0; i < CHUNK_CNT; i++)
+    CHECK (write (fd, buf + i * CHUNK_SIZE, CHUNK_SIZE) == CHUNK_SIZE,
+           "write \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,7 @@
+/* Spawns 16 child processes, each of which grows a separate file
+   at the same time, then verifies the files' contents.  With
+   fine-grained file system locking the writers do not serialize
+   on one another, which shows up in the total run time. */
+
+#define WRITER_CNT 16
+#include "tests/filesys/base/syn-contend.inc"
@@ -0,0 +1,106 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::filesys::base::syn_contend;
+check_syn_contend ([<<'EOF']);
+(syn-contend-16) begin
+(syn-contend-16) create "contend0"
+(syn-contend-16) create "contend1"
+(syn-contend-16) create "contend2"
+(syn-contend-16) create "contend3"
+(syn-contend-16) create "contend4"
+(syn-contend-16) create "contend5"
+(syn-contend-16) create "contend6"
+(syn-contend-16) create "contend7"
+(syn-contend-16) create "contend8"
+(syn-contend-16) create "contend9"
+(syn-contend-16) create "contend10"
+(syn-contend-16) create "contend11"
+(syn-contend-16) create "contend12"
+(syn-contend-16) create "contend13"
+(syn-contend-16) create "contend14"
+(syn-contend-16) create "contend15"
+(syn-contend-16) exec child 1 of 16: "child-syn-contend 0"
+(syn-contend-16) exec child 2 of 16: "child-syn-contend 1"
+(syn-contend-16) exec child 3 of 16: "child-syn-contend 2"
+(syn-contend-16) exec child 4 of 16: "child-syn-contend 3"
+(syn-contend-16) exec child 5 of 16: "child-syn-contend 4"
+(syn-contend-16) exec child 6 of 16: "child-syn-contend 5"
+(syn-contend-16) exec child 7 of 16: "child-syn-contend 6"
+(syn-contend-16) exec child 8 of 16: "child-syn-contend 7"
+(syn-contend-16) exec child 9 of 16: "child-syn-contend 8"
+(syn-contend-16) exec child 10 of 16: "child-syn-contend 9"
+(syn-contend-16) exec child 11 of 16: "child-syn-contend 10"
+(syn-contend-16) exec child 12 of 16: "child-syn-contend 11"
+(syn-contend-16) exec child 13 of 16: "child-syn-contend 12"
+(syn-contend-16) exec child 14 of 16: "child-syn-contend 13"
+(syn-contend-16) exec child 15 of 16: "child-syn-contend 14"
+(syn-contend-16) exec child 16 of 16: "child-syn-contend 15"
+(syn-contend-16) wait for child 1 of 16 returned 0 (expected 0)
+(syn-contend-16) wait for child 2 of 16 returned 1 (expected 1)
+(syn-contend-16) wait for child 3 of 16 returned 2 (expected 2)
+(syn-contend-16) wait for child 4 of 16 returned 3 (expected 3)
+(syn-contend-16) wait for child 5 of 16 returned 4 (expected 4)
+(syn-contend-16) wait for child 6 of 16 returned 5 (expected 5)
+(syn-contend-16) wait for child 7 of 16 returned 6 (expected 6)
+(syn-contend-16) wait for child 8 of 16 returned 7 (expected 7)
+(syn-contend-16) wait for child 9 of 16 returned 8 (expected 8)
+(syn-contend-16) wait for child 10 of 16 returned 9 (expected 9)
+(syn-contend-16) wait for child 11 of 16 returned 10 (expected 10)
+(syn-contend-16) wait for child 12 of 16 returned 11 (expected 11)
+(syn-contend-16) wait for child 13 of 16 returned 12 (expected 12)
+(syn-contend-16) wait for child 14 of 16 returned 13 (expected 13)
+(syn-contend-16) wait for child 15 of 16 returned 14 (expected 14)
+(syn-contend-16) wait for child 16 of 16 returned 15 (expected 15)
+(syn-contend-16) open "contend0" for verification
+(syn-contend-16) verified contents of "contend0"
+(syn-contend-16) close "contend0"
+(syn-contend-16) open "contend1" for verification
+(syn-contend-16) verified contents of "contend1"
+(syn-contend-16) close "contend1"
+(syn-contend-16) open "contend2" for verification
+(syn-contend-16) verified contents of "contend2"
+(syn-contend-16) close "contend2"
+(syn-contend-16) open "contend3" for verification
+(syn-contend-16) verified contents of "contend3"
+(syn-contend-16) close "contend3"
+(syn-contend-16) open "contend4" for verification
+(syn-contend-16) verified contents of "contend4"
+(syn-contend-16) close "contend4"
+(syn-contend-16) open "contend5" for verification
+(syn-contend-16) verified contents of "contend5"
+(syn-contend-16) close "contend5"
+(syn-contend-16) open "contend6" for verification
+(syn-contend-16) verified contents of "contend6"
+(syn-contend-16) close "contend6"
+(syn-contend-16) open "contend7" for verification
+(syn-contend-16) verified contents of "contend7"
+(syn-contend-16) close "contend7"
+(syn-contend-16) open "contend8" for verification
+(syn-contend-16) verified contents of "contend8"
+(syn-contend-16) close "contend8"
+(syn-contend-16) open "contend9" for verification
+(syn-contend-16) verified contents of "contend9"
+(syn-contend-16) close "contend9"
+(syn-contend-16) open "contend10" for verification
+(syn-contend-16) verified contents of "contend10"
+(syn-contend-16) close "contend10"
+(syn-contend-16) open "contend11" for verification
+(syn-contend-16) verified contents of "contend11"
+(syn-contend-16) close "contend11"
+(syn-contend-16) open "contend12" for verification
+(syn-contend-16) verified contents of "contend12"
+(syn-contend-16) close "contend12"
+(syn-contend-16) open "contend13" for verification
+(syn-contend-16) verified contents of "contend13"
+(syn-contend-16) close "contend13"
+(syn-contend-16) open "contend14" for verification
+(syn-contend-16) verified contents of "contend14"
+(syn-contend-16) close "contend14"
+(syn-contend-16) open "contend15" for verification
+(syn-contend-16) verified contents of "contend15"
+(syn-contend-16) close "contend15"
+(syn-contend-16) end
+EOF
+pass;
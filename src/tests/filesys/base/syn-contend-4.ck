@@ -0,0 +1,34 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::filesys::base::syn_contend;
+check_syn_contend ([<<'EOF']);
+(syn-contend-4) begin
+(syn-contend-4) create "contend0"
+(syn-contend-4) create "contend1"
+(syn-contend-4) create "contend2"
+(syn-contend-4) create "contend3"
+(syn-contend-4) exec child 1 of 4: "child-syn-contend 0"
+(syn-contend-4) exec child 2 of 4: "child-syn-contend 1"
+(syn-contend-4) exec child 3 of 4: "child-syn-contend 2"
+(syn-contend-4) exec child 4 of 4: "child-syn-contend 3"
+(syn-contend-4) wait for child 1 of 4 returned 0 (expected 0)
+(syn-contend-4) wait for child 2 of 4 returned 1 (expected 1)
+(syn-contend-4) wait for child 3 of 4 returned 2 (expected 2)
+(syn-contend-4) wait for child 4 of 4 returned 3 (expected 3)
+(syn-contend-4) open "contend0" for verification
+(syn-contend-4) verified contents of "contend0"
+(syn-contend-4) close "contend0"
+(syn-contend-4) open "contend1" for verification
+(syn-contend-4) verified contents of "contend1"
+(syn-contend-4) close "contend1"
+(syn-contend-4) open "contend2" for verification
+(syn-contend-4) verified contents of "contend2"
+(syn-contend-4) close "contend2"
+(syn-contend-4) open "contend3" for verification
+(syn-contend-4) verified contents of "contend3"
+(syn-contend-4) close "contend3"
+(syn-contend-4) end
+EOF
+pass;
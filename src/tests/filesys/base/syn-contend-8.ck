@@ -0,0 +1,58 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::filesys::base::syn_contend;
+check_syn_contend ([<<'EOF']);
+(syn-contend-8) begin
+(syn-contend-8) create "contend0"
+(syn-contend-8) create "contend1"
+(syn-contend-8) create "contend2"
+(syn-contend-8) create "contend3"
+(syn-contend-8) create "contend4"
+(syn-contend-8) create "contend5"
+(syn-contend-8) create "contend6"
+(syn-contend-8) create "contend7"
+(syn-contend-8) exec child 1 of 8: "child-syn-contend 0"
+(syn-contend-8) exec child 2 of 8: "child-syn-contend 1"
+(syn-contend-8) exec child 3 of 8: "child-syn-contend 2"
+(syn-contend-8) exec child 4 of 8: "child-syn-contend 3"
+(syn-contend-8) exec child 5 of 8: "child-syn-contend 4"
+(syn-contend-8) exec child 6 of 8: "child-syn-contend 5"
+(syn-contend-8) exec child 7 of 8: "child-syn-contend 6"
+(syn-contend-8) exec child 8 of 8: "child-syn-contend 7"
+(syn-contend-8) wait for child 1 of 8 returned 0 (expected 0)
+(syn-contend-8) wait for child 2 of 8 returned 1 (expected 1)
+(syn-contend-8) wait for child 3 of 8 returned 2 (expected 2)
+(syn-contend-8) wait for child 4 of 8 returned 3 (expected 3)
+(syn-contend-8) wait for child 5 of 8 returned 4 (expected 4)
+(syn-contend-8) wait for child 6 of 8 returned 5 (expected 5)
+(syn-contend-8) wait for child 7 of 8 returned 6 (expected 6)
+(syn-contend-8) wait for child 8 of 8 returned 7 (expected 7)
+(syn-contend-8) open "contend0" for verification
+(syn-contend-8) verified contents of "contend0"
+(syn-contend-8) close "contend0"
+(syn-contend-8) open "contend1" for verification
+(syn-contend-8) verified contents of "contend1"
+(syn-contend-8) close "contend1"
+(syn-contend-8) open "contend2" for verification
+(syn-contend-8) verified contents of "contend2"
+(syn-contend-8) close "contend2"
+(syn-contend-8) open "contend3" for verification
+(syn-contend-8) verified contents of "contend3"
+(syn-contend-8) close "contend3"
+(syn-contend-8) open "contend4" for verification
+(syn-contend-8) verified contents of "contend4"
+(syn-contend-8) close "contend4"
+(syn-contend-8) open "contend5" for verification
+(syn-contend-8) verified contents of "contend5"
+(syn-contend-8) close "contend5"
+(syn-contend-8) open "contend6" for verification
+(syn-contend-8) verified contents of "contend6"
+(syn-contend-8) close "contend6"
+(syn-contend-8) open "contend7" for verification
+(syn-contend-8) verified contents of "contend7"
+(syn-contend-8) close "contend7"
+(syn-contend-8) end
+EOF
+pass;
@@ -0,0 +1,8 @@
+#ifndef TESTS_FILESYS_BASE_SYN_CONTEND_H
+#define TESTS_FILESYS_BASE_SYN_CONTEND_H
+
+#define CHUNK_SIZE 512
+#define CHUNK_CNT 32
+#define FILE_SIZE (CHUNK_CNT * CHUNK_SIZE)
+
+#endif /* tests/filesys/base/syn-contend.h */
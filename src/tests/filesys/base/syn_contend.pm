@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Checks the output of a syn-contend test against EXPECTED,
+# after requiring and then setting aside its throughput line,
+# whose tick count varies from run to run.
+sub check_syn_contend {
+    my ($expected) = @_;
+    our ($test);
+    my (@output) = read_text_file ("$test.output");
+
+    common_checks ("run", @output);
+    my ($throughput) = qr/^\(syn-contend-\d+\) throughput: \d+ bytes in \d+ ticks \(\d+ bytes\/tick\)$/;
+    fail "Output missing throughput message.\n"
+      if !grep (/$throughput/, @output);
+    @output = grep (!/$throughput/, @output);
+    compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, $expected);
+}
+
+1;
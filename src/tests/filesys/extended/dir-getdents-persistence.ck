@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"d" => {"x" => ["\0" x 100], "y" => [""], "sub" => {}}});
+pass;
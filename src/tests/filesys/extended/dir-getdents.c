@@ -0,0 +1,48 @@
+/* Lists a directory with getdents(), a few entries at a time,
+   and checks that each entry is returned once with the right
+   type and size. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  struct dirent entries[2];
+  bool seen_x = false, seen_y = false, seen_sub = false;
+  int total = 0;
+  int fd, cnt, i;
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (create ("d/x", 100), "create \"d/x\"");
+  CHECK (create ("d/y", 0), "create \"d/y\"");
+  CHECK (mkdir ("d/sub"), "mkdir \"d/sub\"");
+  CHECK ((fd = open ("d")) > 1, "open \"d\"");
+
+  msg ("getdents \"d\"");
+  while ((cnt = getdents (fd, entries, sizeof entries / sizeof *entries)) > 0)
+    for (i = 0; i < cnt; i++)
+      {
+        struct dirent *e = &entries[i];
+        bool *seen;
+
+        if (!strcmp (e->name, "x") && !e->is_dir && e->size == 100)
+          seen = &seen_x;
+        else if (!strcmp (e->name, "y") && !e->is_dir && e->size == 0)
+          seen = &seen_y;
+        else if (!strcmp (e->name, "sub") && e->is_dir)
+          seen = &seen_sub;
+        else
+          fail ("unexpected entry \"%s\"", e->name);
+        if (*seen)
+          fail ("\"%s\" returned twice", e->name);
+        *seen = true;
+        total++;
+      }
+  CHECK (cnt == 0, "getdents at end (must return 0, actually %d)", cnt);
+  CHECK (total == 3, "3 entries (actually %d)", total);
+  CHECK (getdents (fd, entries, 1) == 0, "getdents after end");
+  close (fd);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "d"
+(dir-getdents) create "d/x"
+(dir-getdents) create "d/y"
+(dir-getdents) mkdir "d/sub"
+(dir-getdents) open "d"
+(dir-getdents) getdents "d"
+(dir-getdents) getdents at end
+(dir-getdents) 3 entries
+(dir-getdents) getdents after end
+(dir-getdents) end
+EOF
+pass;
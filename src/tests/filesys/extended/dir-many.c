@@ -0,0 +1,84 @@
+/* Creates more files in one directory than a full table of
+   directory blocks can hold, so that the directory's blocks
+   split, its bucket table doubles to its largest size, and then
+   overflow blocks are chained.  Then checks that every name can
+   be looked up, is listed exactly once by readdir(), and can be
+   removed, leaving the directory empty. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* A table of 128 blocks holds 128 * 25 = 3,200 names. */
+#define FILE_CNT 3300
+
+static bool seen[FILE_CNT];
+
+/* Returns the name of file I. */
+static const char *
+file_name (int i) 
+{
+  static char name[16];
+  snprintf (name, sizeof name, "file%d", i);
+  return name;
+}
+
+void
+test_main (void) 
+{
+  char name[READDIR_MAX_LEN + 1];
+  int fd, i, cnt;
+
+  CHECK (mkdir ("many"), "mkdir \"many\"");
+  CHECK (chdir ("many"), "chdir \"many\"");
+
+  msg ("create %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    if (!create (file_name (i), 0))
+      fail ("create \"%s\" failed", file_name (i));
+
+  msg ("open each file");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      fd = open (file_name (i));
+      if (fd < 2)
+        fail ("open \"%s\" failed", file_name (i));
+      close (fd);
+    }
+  CHECK (open (file_name (FILE_CNT)) == -1,
+         "open \"%s\" (must return -1)", file_name (FILE_CNT));
+
+  CHECK ((fd = open (".")) > 1, "open \".\"");
+  msg ("readdir \".\"");
+  cnt = 0;
+  while (readdir (fd, name))
+    {
+      if (memcmp (name, "file", 4)
+          || (i = atoi (name + 4)) < 0 || i >= FILE_CNT
+          || strcmp (name, file_name (i)))
+        fail ("unexpected entry \"%s\"", name);
+      if (seen[i])
+        fail ("\"%s\" returned twice", name);
+      seen[i] = true;
+      cnt++;
+    }
+  close (fd);
+  CHECK (cnt == FILE_CNT, "%d entries (actually %d)", FILE_CNT, cnt);
+
+  msg ("remove each file");
+  for (i = 0; i < FILE_CNT; i++)
+    if (!remove (file_name (i)))
+      fail ("remove \"%s\" failed", file_name (i));
+  for (i = 0; i < FILE_CNT; i++)
+    if (open (file_name (i)) != -1)
+      fail ("\"%s\" still exists after remove", file_name (i));
+
+  CHECK ((fd = open (".")) > 1, "open \".\"");
+  CHECK (!readdir (fd, name), "readdir \".\" (must return false)");
+  close (fd);
+  CHECK (chdir ("/"), "chdir \"/\"");
+  CHECK (remove ("many"), "remove \"many\"");
+}
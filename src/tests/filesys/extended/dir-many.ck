@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-many) begin
+(dir-many) mkdir "many"
+(dir-many) chdir "many"
+(dir-many) create 3300 files
+(dir-many) open each file
+(dir-many) open "file3300" (must return -1)
+(dir-many) open "."
+(dir-many) readdir "."
+(dir-many) 3300 entries (actually 3300)
+(dir-many) remove each file
+(dir-many) open "."
+(dir-many) readdir "." (must return false)
+(dir-many) chdir "/"
+(dir-many) remove "many"
+(dir-many) end
+EOF
+pass;
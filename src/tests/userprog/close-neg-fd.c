@@ -0,0 +1,21 @@
+/* Tries to close fds just outside the file descriptor table,
+   which must either fail silently or terminate with exit code
+   -1, and then checks that files can still be opened and read. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int handle;
+  char c;
+
+  close (-1);
+  close (64);
+  close (-0x1000);
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (read (handle, &c, 1) == 1, "read \"sample.txt\"");
+  close (handle);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF', <<'EOF']);
+(close-neg-fd) begin
+(close-neg-fd) open "sample.txt"
+(close-neg-fd) read "sample.txt"
+(close-neg-fd) end
+close-neg-fd: exit(0)
+EOF
+(close-neg-fd) begin
+close-neg-fd: exit(-1)
+EOF
+pass;
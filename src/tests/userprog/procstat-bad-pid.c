@@ -0,0 +1,14 @@
+/* Asks for the CPU accounting of an invalid pid, which must
+   fail without killing the process. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct procstat st;
+
+  CHECK (!procstat ((pid_t) 0x0c020301, &st), "procstat of invalid pid");
+}
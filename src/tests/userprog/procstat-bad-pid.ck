@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(procstat-bad-pid) begin
+(procstat-bad-pid) procstat of invalid pid
+(procstat-bad-pid) end
+procstat-bad-pid: exit(0)
+EOF
+pass;
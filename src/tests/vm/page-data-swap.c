@@ -0,0 +1,55 @@
+/* Modifies a page of the data segment, then forces it out to
+   swap twice by writing a buffer larger than physical memory,
+   and checks that the modification survives both times.  A
+   data page read back from swap must stay swap-backed: if it
+   were treated as an unmodified page of the executable, the
+   second eviction would drop it and the page would revert to
+   its original contents. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+
+/* Initialized, so that it is in the data segment. */
+static char data[4096] = "original contents";
+
+static char buf[SIZE];
+
+/* Writes all of buf, twice, so that every page not in use is
+   evicted. */
+static void
+sweep (void)
+{
+  memset (buf, 0x5a, sizeof buf);
+  memset (buf, 0xa5, sizeof buf);
+}
+
+/* Fails unless every byte of data is 'x'. */
+static void
+check_data (void)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof data; i++)
+    if (data[i] != 'x')
+      fail ("data[%zu] is %d, expected 'x'", i, data[i]);
+}
+
+void
+test_main (void)
+{
+  msg ("modify data page");
+  memset (data, 'x', sizeof data);
+
+  msg ("evict data page");
+  sweep ();
+  msg ("check data page");
+  check_data ();
+
+  msg ("evict data page again");
+  sweep ();
+  msg ("check data page");
+  check_data ();
+}
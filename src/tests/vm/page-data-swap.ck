@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-data-swap) begin
+(page-data-swap) modify data page
+(page-data-swap) evict data page
+(page-data-swap) check data page
+(page-data-swap) evict data page again
+(page-data-swap) check data page
+(page-data-swap) end
+EOF
+pass;
@@ -22,6 +22,7 @@
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -37,6 +38,10 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -57,6 +62,9 @@ static const char *swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -trace: Record kernel events and save them to scratch? */
+static bool trace_events;
+
 static void bss_init (void);
 static void paging_init (void);
 
@@ -98,6 +106,11 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+  if (trace_events)
+    trace_init ();
+#ifdef VM
+  vm_frame_init ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -126,6 +139,9 @@ main (void)
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
+#ifdef VM
+  vm_swap_init ();
+#endif
 
   printf ("Boot complete.\n");
   
@@ -247,6 +263,10 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-dma"))
+        ide_dma = true;
+      else if (!strcmp (name, "-trace"))
+        trace_events = true;
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -256,6 +276,15 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-hz"))
+        {
+          timer_freq = atoi (value);
+          if (timer_freq < TIMER_FREQ_MIN || timer_freq > TIMER_FREQ_MAX)
+            PANIC ("timer frequency must be between %d and %d Hz",
+                   TIMER_FREQ_MIN, TIMER_FREQ_MAX);
+        }
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -373,12 +402,16 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -dma               Use bus-master DMA for IDE disks if possible.\n"
+          "  -trace             Trace kernel events to scratch device.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -hz=FREQ           Interrupt FREQ times per second (default 100).\n"
+          "  -tickless          Stop the timer tick while the CPU is idle.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
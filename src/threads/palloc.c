@@ -148,6 +148,31 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void)
+{
+  return bitmap_size (user_pool.used_map);
+}
+
+/* Returns the page with index IDX in the user pool. */
+void *
+palloc_user_page (size_t idx)
+{
+  ASSERT (idx < palloc_user_page_cnt ());
+  return user_pool.base + idx * PGSIZE;
+}
+
+/* Returns the index within the user pool of PAGE, which must
+   belong to the user pool.  Together with palloc_user_page(),
+   this lets other modules keep per-frame data in an array. */
+size_t
+palloc_user_page_idx (const void *page)
+{
+  ASSERT (page_from_pool (&user_pool, (void *) page));
+  return pg_no (page) - pg_no (user_pool.base);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
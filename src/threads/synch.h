@@ -20,8 +20,9 @@ void sema_self_test (void);
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's held_locks. */
   };
 
 void lock_init (struct lock *);
@@ -41,6 +42,23 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rw_lock
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition readers_ok; /* Signaled when readers may enter. */
+    struct condition writers_ok; /* Signaled when a writer may enter. */
+    int readers;                /* Number of readers inside. */
+    bool writer;                /* Is a writer inside? */
+    int waiting_writers;        /* Number of writers waiting to enter. */
+  };
+
+void rw_lock_init (struct rw_lock *);
+void rw_lock_acquire_read (struct rw_lock *);
+void rw_lock_release_read (struct rw_lock *);
+void rw_lock_acquire_write (struct rw_lock *);
+void rw_lock_release_write (struct rw_lock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
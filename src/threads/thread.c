@@ -4,12 +4,15 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 
 #include "filesys/file.h"
@@ -23,9 +26,14 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, with one FIFO queue per
+   priority.  Bit P of ready_mask is set if and only if
+   ready_queues[P] is nonempty, so that the highest-priority
+   ready thread can be found in constant time. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint32_t ready_mask[(PRI_MAX + 32) / 32];
+static int ready_cnt;           /* Number of threads in ready_queues. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -52,6 +60,19 @@ struct kernel_thread_frame
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
+static long long switch_cnt;    /* # of context switches. */
+
+/* Histogram of the time threads spend ready before they run, in
+   timer ticks.  Bucket 0 counts waits of 0 ticks, bucket I
+   counts waits of 2**(I-1) to 2**I - 1 ticks, and the last
+   bucket counts all longer waits as well. */
+#define WAIT_BUCKETS 8
+static long long wait_histogram[WAIT_BUCKETS];
+
+/* True while the running thread is being preempted, as opposed
+   to yielding of its own accord.  Only meaningful with
+   interrupts off. */
+static bool preempting;
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
@@ -62,11 +83,36 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler.
+
+   recent_cpu is charged to the running thread each tick, and
+   decayed and load_avg recomputed for everyone once a second.
+   Between those full passes, only threads whose recent_cpu was
+   charged since the last recomputation, which are kept on
+   mlfqs_dirty_list, have their priorities recomputed every
+   PRIORITY_TICKS ticks, so that a tick costs time in proportion
+   to the threads that actually ran rather than to all threads. */
+#define PRIORITY_TICKS 4        /* # of ticks between recomputations. */
+#define NICE_MIN -20            /* Lowest niceness. */
+#define NICE_MAX 20             /* Highest niceness. */
+static int load_avg;            /* System load average, fixed-point. */
+static struct list mlfqs_dirty_list;
+
 static void kernel_thread (thread_func *, void *aux);
+static void yield (bool voluntary);
+static void account_wait (struct thread *);
+static void print_thread_stats (struct thread *, void *aux);
 
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
+static void ready_insert (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_max_priority (void);
+static void set_effective_priority (struct thread *, int priority);
+static void mlfqs_tick (struct thread *);
+static void mlfqs_update_priority (struct thread *, void *aux);
+static void mlfqs_decay_recent_cpu (struct thread *, void *aux);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
@@ -111,11 +157,15 @@ void sendsig_thread (tid_t tid, int signum){
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
   list_init (&all_list);
+  list_init (&mlfqs_dirty_list);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -153,22 +203,74 @@ thread_tick (void)
     idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    {
+      user_ticks++;
+      t->user_ticks++;
+    }
 #endif
   else
-    kernel_ticks++;
+    {
+      kernel_ticks++;
+      t->kernel_ticks++;
+    }
+
+  if (thread_mlfqs)
+    mlfqs_tick (t);
 
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
-/* Prints thread statistics. */
+/* Accounts for TICKS timer ticks that passed without timer
+   interrupts while the idle thread ran. */
+void
+thread_account_idle (int64_t ticks)
+{
+  idle_ticks += ticks;
+}
+
+/* Prints thread statistics: totals, the run queue wait-time
+   histogram, and accounting for each thread still alive. */
 void
 thread_print_stats (void) 
 {
+  enum intr_level old_level;
+  int i;
+
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %lld context switches, ready wait histogram (ticks):",
+          switch_cnt);
+  for (i = 0; i < WAIT_BUCKETS; i++)
+    {
+      int low = i == 0 ? 0 : 1 << (i - 1);
+      int high = i == 0 ? 0 : (1 << i) - 1;
+
+      if (i == WAIT_BUCKETS - 1)
+        printf (" %d+:%lld", low, wait_histogram[i]);
+      else if (low == high)
+        printf (" %d:%lld", low, wait_histogram[i]);
+      else
+        printf (" %d-%d:%lld", low, high, wait_histogram[i]);
+    }
+  printf ("\n");
+
+  old_level = intr_disable ();
+  thread_foreach (print_thread_stats, NULL);
+  intr_set_level (old_level);
+}
+
+/* Prints T's accounting. */
+static void
+print_thread_stats (struct thread *t, void *aux UNUSED)
+{
+  printf ("Thread %d (%s): %lld user ticks, %lld kernel ticks, "
+          "%u voluntary and %u involuntary switches, "
+          "%lld ticks ready (max %lld)\n",
+          t->tid, t->name, t->user_ticks, t->kernel_ticks,
+          t->voluntary_switches, t->involuntary_switches,
+          t->wait_ticks, t->max_wait_ticks);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -183,9 +285,10 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, it preempts the running thread before thread_create()
+   returns.  PRIORITY is ignored under the multi-level feedback
+   queue scheduler. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -207,9 +310,12 @@ thread_create (const char *name, int priority,
     return TID_ERROR;
 
 
-  /* Initialize thread. */
+  /* Initialize thread.  The multi-level feedback queue scheduler
+     sets priorities itself, except for the idle thread's. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  if (thread_mlfqs && function != idle)
+    mlfqs_update_priority (t, NULL);
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -229,6 +335,7 @@ thread_create (const char *name, int priority,
  
   /* Add to run queue. */
   thread_unblock (t);
+  thread_yield_to_higher ();
 
   return tid;
 }
@@ -253,10 +360,11 @@ thread_block (void)
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   This function does not preempt the running thread, even if T
+   has a higher priority.  This can be important: if the caller
+   had disabled interrupts itself, it may expect that it can
+   atomically unblock a thread and update other data.  Call
+   thread_yield_to_higher() afterward to preempt. */
 void
 thread_unblock (struct thread *t) 
 {
@@ -266,8 +374,9 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  ready_insert (t);
   t->status = THREAD_READY;
+  t->ready_since = timer_ticks ();
   intr_set_level (old_level);
 }
 
@@ -320,6 +429,8 @@ thread_exit (void)
      when it calls thread_schedule_tail(). */
   intr_disable ();
   list_remove (&thread_current()->allelem);
+  if (thread_current ()->mlfqs_dirty)
+    list_remove (&thread_current ()->mlfqs_elem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -329,6 +440,24 @@ thread_exit (void)
    may be scheduled again immediately at the scheduler's whim. */
 void
 thread_yield (void) 
+{
+  yield (true);
+}
+
+/* Like thread_yield(), but for when the running thread is being
+   preempted, by the end of its time slice or by a thread with
+   higher priority, rather than giving up the CPU of its own
+   accord.  The difference only matters for accounting. */
+void
+thread_preempt (void)
+{
+  yield (false);
+}
+
+/* Puts the running thread back on the run queue and schedules
+   another, counting the switch as VOLUNTARY or not. */
+static void
+yield (bool voluntary)
 {
   struct thread *cur = thread_current ();
   enum intr_level old_level;
@@ -337,12 +466,38 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+    ready_insert (cur);
   cur->status = THREAD_READY;
+  cur->ready_since = timer_ticks ();
+  preempting = !voluntary;
   schedule ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if a thread with a higher priority than the
+   running thread is ready to run.  In an interrupt handler, the
+   yield happens just before the interrupt returns. */
+void
+thread_yield_to_higher (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool preempt;
+
+  old_level = intr_disable ();
+  preempt = (ready_max_priority () > cur->priority
+             || (cur == idle_thread && ready_max_priority () >= PRI_MIN));
+  intr_set_level (old_level);
+
+  if (preempt)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_preempt ();
+    }
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
    This function must be called with interrupts off. */
 void
@@ -360,11 +515,90 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's priority to NEW_PRIORITY.  Donated
+   priority still applies until the locks it was donated for are
+   released.  Yields if the thread no longer has the highest
+   priority.  Has no effect under the multi-level feedback queue
+   scheduler, which sets priorities itself. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_update_priority (cur);
+  intr_set_level (old_level);
+
+  thread_yield_to_higher ();
+}
+
+/* Raises T's priority to PRIORITY, if that is higher, on behalf
+   of a thread waiting for a lock that T holds.  Must be called
+   with interrupts off. */
+void
+thread_donate_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (priority > t->priority)
+    set_effective_priority (t, priority);
+}
+
+/* Recomputes T's priority as the higher of its base priority and
+   the priorities of the threads waiting for locks it holds.
+   Must be called with interrupts off. */
+void
+thread_update_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+  struct list_elem *e, *w;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_mlfqs)
+    {
+      /* There is no donation to account for. */
+      set_effective_priority (t, priority);
+      return;
+    }
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      struct list *waiters = &lock->semaphore.waiters;
+
+      for (w = list_begin (waiters); w != list_end (waiters);
+           w = list_next (w))
+        {
+          struct thread *waiter = list_entry (w, struct thread, elem);
+          if (waiter->priority > priority)
+            priority = waiter->priority;
+        }
+    }
+  set_effective_priority (t, priority);
+}
+
+/* Sets T's effective priority to PRIORITY, moving T to the
+   matching run queue if it is ready. */
+static void
+set_effective_priority (struct thread *t, int priority)
+{
+  if (t->priority == priority)
+    return;
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_insert (t);
+    }
+  else
+    t->priority = priority;
 }
 
 /* Returns the current thread's priority. */
@@ -374,37 +608,131 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if (nice < NICE_MIN)
+    nice = NICE_MIN;
+  else if (nice > NICE_MAX)
+    nice = NICE_MAX;
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (cur, NULL);
+  intr_set_level (old_level);
+
+  thread_yield_to_higher ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = CONVERT_TO_INT_NEAREST (MULT_INT (load_avg, 100));
+  intr_set_level (old_level);
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100 = CONVERT_TO_INT_NEAREST (
+    MULT_INT (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent_cpu_100;
 }
-
+
+/* Does the multi-level feedback queue scheduler's work for a
+   timer tick during which T was running.  Runs in the timer
+   interrupt. */
+static void
+mlfqs_tick (struct thread *t)
+{
+  int64_t ticks = timer_ticks ();
+
+  if (t != idle_thread)
+    {
+      t->recent_cpu = ADD_INT (t->recent_cpu, 1);
+      if (!t->mlfqs_dirty)
+        {
+          t->mlfqs_dirty = true;
+          list_push_back (&mlfqs_dirty_list, &t->mlfqs_elem);
+        }
+    }
+
+  if (ticks % TIMER_FREQ == 0)
+    {
+      /* load_avg = (59/60) * load_avg + (1/60) * ready_threads. */
+      int ready_threads = ready_cnt + (t != idle_thread ? 1 : 0);
+      load_avg = ADD (DIV_INT (MULT_INT (load_avg, 59), 60),
+                      DIV_INT (CONVERT_TO_FP (ready_threads), 60));
+
+      /* Every thread's recent_cpu changes, so recompute every
+         priority. */
+      thread_foreach (mlfqs_decay_recent_cpu, NULL);
+      thread_foreach (mlfqs_update_priority, NULL);
+    }
+  else if (ticks % PRIORITY_TICKS == 0)
+    while (!list_empty (&mlfqs_dirty_list))
+      mlfqs_update_priority (list_entry (list_front (&mlfqs_dirty_list),
+                                         struct thread, mlfqs_elem), NULL);
+}
+
+/* Decays T's recent_cpu by the load average.  Called once a
+   second. */
+static void
+mlfqs_decay_recent_cpu (struct thread *t, void *aux UNUSED)
+{
+  int twice_load = MULT_INT (load_avg, 2);
+  int coefficient = DIVIDE (twice_load, ADD_INT (twice_load, 1));
+
+  if (t != idle_thread)
+    t->recent_cpu = ADD_INT (MULTIPLE (coefficient, t->recent_cpu),
+                             t->nice);
+}
+
+/* Recomputes T's priority from its recent_cpu and nice values
+   and takes it off mlfqs_dirty_list. */
+static void
+mlfqs_update_priority (struct thread *t, void *aux UNUSED)
+{
+  int priority = (PRI_MAX - CONVERT_TO_INT_ZERO (DIV_INT (t->recent_cpu, 4))
+                  - t->nice * 2);
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+
+  if (t->mlfqs_dirty)
+    {
+      list_remove (&t->mlfqs_elem);
+      t->mlfqs_dirty = false;
+    }
+  if (t != idle_thread)
+    {
+      t->base_priority = priority;
+      set_effective_priority (t, priority);
+    }
+}
+
 /* Idle thread.  Executes when no other thread is ready to run.
 
    The idle thread is initially put on the ready list by
@@ -427,6 +755,10 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Stop the periodic tick, if tickless idle is enabled.
+         thread_schedule_tail() restarts it when we stop running. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -490,7 +822,15 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  if (t != running_thread ())
+    {
+      /* Inherit the creating thread's scheduling history. */
+      t->nice = running_thread ()->nice;
+      t->recent_cpu = running_thread ()->recent_cpu;
+    }
+  list_init (&t->held_locks);
+  t->waiting_lock = NULL;
   t->magic = THREAD_MAGIC;
 
   old_level = intr_disable ();
@@ -520,6 +860,16 @@ init_thread (struct thread *t, const char *name, int priority)
 	t->save_signal[j]=NULL;
   }
 
+#ifdef FILESYS
+  t->cwd = NULL;
+#endif
+
+#ifdef VM
+  t->prefetch_window = 1;
+  t->exec_file = NULL;
+  list_init (&t->mmaps);
+  t->next_mapid = 0;
+#endif
 
 #endif
 
@@ -544,14 +894,57 @@ alloc_frame (struct thread *t, size_t size)
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.
+
+   Picks the thread at the front of the highest-priority
+   nonempty queue, so threads of equal priority take turns. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  int priority = ready_max_priority ();
+  struct thread *t;
+
+  if (priority < PRI_MIN)
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  t = list_entry (list_front (&ready_queues[priority]), struct thread, elem);
+  ready_remove (t);
+  return t;
+}
+
+/* Adds T to the back of the run queue for its priority. */
+static void
+ready_insert (struct thread *t)
+{
+  int p = t->priority;
+
+  list_push_back (&ready_queues[p], &t->elem);
+  ready_mask[p / 32] |= 1u << (p % 32);
+  ready_cnt++;
+}
+
+/* Removes T from the run queue for its priority. */
+static void
+ready_remove (struct thread *t)
+{
+  int p = t->priority;
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[p]))
+    ready_mask[p / 32] &= ~(1u << (p % 32));
+  ready_cnt--;
+}
+
+/* Returns the highest priority of any ready thread, or -1 if no
+   thread is ready. */
+static int
+ready_max_priority (void)
+{
+  int i;
+
+  for (i = sizeof ready_mask / sizeof *ready_mask - 1; i >= 0; i--)
+    if (ready_mask[i] != 0)
+      return i * 32 + 31 - __builtin_clz (ready_mask[i]);
+  return -1;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -579,10 +972,16 @@ thread_schedule_tail (struct thread *prev)
 
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
+  if (prev != NULL)
+    trace (TRACE_SCHEDULE, prev->tid, prev->status);
 
   /* Start new time slice. */
   thread_ticks = 0;
 
+  /* Restart the periodic tick if the idle thread stopped it. */
+  if (prev != NULL && prev == idle_thread)
+    timer_idle_exit ();
+
 #ifdef USERPROG
   /* Activate the new address space. */
   process_activate ();
@@ -618,11 +1017,41 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  if (cur != next)
+    {
+      switch_cnt++;
+      if (preempting && cur->status == THREAD_READY)
+        cur->involuntary_switches++;
+      else
+        cur->voluntary_switches++;
+      if (next != idle_thread)
+        account_wait (next);
+    }
+  preempting = false;
+
   if (cur != next)
     prev = switch_threads (cur, next);
   thread_schedule_tail (prev);
 }
 
+/* Records how long T, which is about to run, waited on the run
+   queue. */
+static void
+account_wait (struct thread *t)
+{
+  int64_t wait = timer_ticks () - t->ready_since;
+  int bucket;
+
+  t->wait_ticks += wait;
+  if (wait > t->max_wait_ticks)
+    t->max_wait_ticks = wait;
+
+  for (bucket = 0; bucket < WAIT_BUCKETS - 1 && wait >= (1 << bucket);
+       bucket++)
+    continue;
+  wait_histogram[bucket]++;
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void) 
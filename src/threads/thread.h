@@ -101,12 +101,35 @@ struct thread{
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Priority, including donations. */
+    int base_priority;                  /* Priority before donations. */
     struct list_elem allelem;           /* List element for all threads list. */
 
+    /* CPU accounting, owned by thread.c. */
+    long long user_ticks;               /* Ticks spent in user mode. */
+    long long kernel_ticks;             /* Ticks spent in kernel mode. */
+    unsigned voluntary_switches;        /* Times it blocked or yielded. */
+    unsigned involuntary_switches;      /* Times it was preempted. */
+    int64_t ready_since;                /* Tick it last became ready. */
+    long long wait_ticks;               /* Total ticks spent ready. */
+    long long max_wait_ticks;           /* Longest single wait when ready. */
+
+    /* Multi-level feedback queue scheduler, owned by thread.c. */
+    int nice;                           /* Niceness. */
+    int recent_cpu;                     /* Recent CPU use, fixed-point. */
+    bool mlfqs_dirty;                   /* In mlfqs_dirty_list? */
+    struct list_elem mlfqs_elem;        /* Element in mlfqs_dirty_list. */
+
+    /* Shared between thread.c and synch.c. */
+    struct list held_locks;             /* Locks held, for donation. */
+    struct lock *waiting_lock;          /* Lock being waited for, or null. */
+
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
 
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_tick;                /* Tick to wake up at, if sleeping. */
+
 //#ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
@@ -124,9 +147,31 @@ struct thread{
 	struct file *fdt[64];
 	int next_fd;
 	struct hash suppl_page_table;
+#ifdef VM
+	/* Guards suppl_page_table, which the evictor also reads and
+	   updates while running in another thread. */
+	struct lock spt_lock;
+
+	/* Swap read-around, owned by vm/page.c. */
+	int prefetch_window;                /* Pages to prefetch per fault. */
+	void *prefetched[8];                /* Pages prefetched last time. */
+	int prefetched_cnt;                 /* Entries in prefetched[]. */
+	void *last_swap_fault;              /* Page of last swap-in fault. */
+
+	/* Demand paging, owned by userprog/process.c. */
+	struct file *exec_file;             /* Executable, open while running. */
+	void *user_esp;                     /* User esp at system call entry. */
+
+	/* Memory-mapped files, owned by userprog/syscall.c. */
+	struct list mmaps;                  /* List of struct mmap_desc. */
+	int next_mapid;                     /* Identifier for next mapping. */
+#endif
 	struct signal *save_signal[10];
 
 	int exit_status;
+#ifdef FILESYS
+	struct dir *cwd;                    /* Working directory, or null for root. */
+#endif
 
 
 //#endif
@@ -147,6 +192,7 @@ void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_account_idle (int64_t ticks);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -161,6 +207,8 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
+void thread_yield_to_higher (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -168,6 +216,8 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_donate_priority (struct thread *, int priority);
+void thread_update_priority (struct thread *);
 struct thread * thread_get_by_id (tid_t);
 int thread_get_nice (void);
 void thread_set_nice (int);
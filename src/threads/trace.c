@@ -0,0 +1,148 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Size of the ring, in pages. */
+#define TRACE_PAGES 32
+
+/* Number of records in the ring. */
+#define TRACE_RECORDS (TRACE_PAGES * PGSIZE / sizeof (struct trace_record))
+
+/* Identifies the header sector of a trace dump. */
+#define TRACE_MAGIC "PINTRACE"
+#define TRACE_VERSION 1
+
+/* A traced event.  32 bytes, so that a sector holds a whole
+   number of records. */
+struct trace_record
+  {
+    uint64_t tsc;                       /* CPU time-stamp counter. */
+    int64_t ticks;                      /* Timer ticks since boot. */
+    uint32_t seq;                       /* Sequence number. */
+    uint16_t event;                     /* An enum trace_event. */
+    uint16_t tid;                       /* Running thread. */
+    uint32_t arg0, arg1;                /* Meaning depends on event. */
+  };
+
+/* First sector of a trace dump, followed by the ring exactly as
+   it is laid out in memory.  The record with sequence number
+   SEQ is at index SEQ % record_cnt.  The last min(next_seq,
+   record_cnt) sequence numbers are valid. */
+struct trace_header
+  {
+    char magic[8];                      /* TRACE_MAGIC, without null. */
+    uint32_t version;                   /* TRACE_VERSION. */
+    uint32_t record_size;               /* Size of a record in bytes. */
+    uint32_t record_cnt;                /* Number of records in ring. */
+    uint32_t next_seq;                  /* Sequence number of next record. */
+    uint32_t timer_freq;                /* Timer ticks per second. */
+    uint32_t unused0;                   /* Padding. */
+    uint64_t tsc_per_tick;              /* TSC increments per timer tick. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 40]; /* Padding. */
+  };
+
+/* True while tracepoints record events. */
+bool trace_enabled;
+
+static struct trace_record *ring;       /* TRACE_RECORDS records. */
+static uint32_t next_seq;               /* Sequence number of next record. */
+
+/* Time-stamp counter and timer ticks when tracing started, to
+   calibrate the time-stamp counter against the timer. */
+static uint64_t start_tsc;
+static int64_t start_ticks;
+
+/* Allocates the trace ring and starts recording events. */
+void
+trace_init (void)
+{
+  ASSERT (sizeof (struct trace_record) == 32);
+  ASSERT (sizeof (struct trace_header) == BLOCK_SECTOR_SIZE);
+
+  ring = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, TRACE_PAGES);
+  next_seq = 0;
+  start_tsc = rdtsc ();
+  start_ticks = timer_ticks ();
+  trace_enabled = true;
+}
+
+/* Appends EVENT with arguments ARG0 and ARG1 to the ring.  Use
+   trace() instead of calling this directly.  May be called from
+   an interrupt handler. */
+void
+trace_record (enum trace_event event, uint32_t arg0, uint32_t arg1)
+{
+  enum intr_level old_level;
+  struct trace_record *r;
+
+  ASSERT (event < TRACE_EVENT_CNT);
+
+  old_level = intr_disable ();
+  r = &ring[next_seq % TRACE_RECORDS];
+  r->tsc = rdtsc ();
+  r->ticks = timer_ticks ();
+  r->seq = next_seq++;
+  r->event = event;
+  r->tid = thread_tid ();
+  r->arg0 = arg0;
+  r->arg1 = arg1;
+  intr_set_level (old_level);
+}
+
+/* Stops tracing and writes the ring to the start of the scratch
+   device, overwriting whatever is there.  Does nothing if
+   tracing was not enabled. */
+void
+trace_dump (void)
+{
+  static struct trace_header header;
+  struct block_iovec iov[2];
+  struct block *scratch;
+  int64_t elapsed;
+
+  if (!trace_enabled)
+    return;
+  trace_enabled = false;
+
+  iov[0].buffer = &header;
+  iov[0].cnt = 1;
+  iov[1].buffer = ring;
+  iov[1].cnt = TRACE_PAGES * PGSIZE / BLOCK_SECTOR_SIZE;
+
+  scratch = block_get_role (BLOCK_SCRATCH);
+  if (scratch == NULL)
+    {
+      printf ("trace: no scratch device, trace discarded\n");
+      return;
+    }
+  if (block_size (scratch) < iov[0].cnt + iov[1].cnt)
+    {
+      printf ("trace: scratch device %s too small for trace "
+              "(need %"PRDSNu" sectors)\n",
+              block_name (scratch), iov[0].cnt + iov[1].cnt);
+      return;
+    }
+
+  memcpy (header.magic, TRACE_MAGIC, sizeof header.magic);
+  header.version = TRACE_VERSION;
+  header.record_size = sizeof (struct trace_record);
+  header.record_cnt = TRACE_RECORDS;
+  header.next_seq = next_seq;
+  header.timer_freq = TIMER_FREQ;
+  elapsed = timer_elapsed (start_ticks);
+  header.tsc_per_tick = elapsed > 0 ? (rdtsc () - start_tsc) / elapsed : 0;
+
+  block_writev (scratch, 0, iov, 2);
+  printf ("trace: %"PRIu32" events, %zu saved to %s\n",
+          next_seq, next_seq < TRACE_RECORDS ? next_seq : TRACE_RECORDS,
+          block_name (scratch));
+}
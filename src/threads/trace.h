@@ -0,0 +1,46 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Kernel trace ring.
+
+   With the -trace kernel option, each tracepoint the kernel
+   passes appends a small binary record to an in-memory ring,
+   overwriting the oldest record once the ring is full.  At
+   shutdown the ring is written to the scratch device, where
+   utils/pintos-trace can decode it.  Unlike printf(), recording
+   an event never touches the console, so it is cheap enough to
+   leave in hot paths. */
+
+/* Traced events.  The comment gives the meaning of each event's
+   two arguments.  utils/pintos-trace knows these numbers, so
+   only append to this list. */
+enum trace_event
+  {
+    TRACE_SCHEDULE,             /* Previous thread's tid and status. */
+    TRACE_PAGE_FAULT,           /* Fault address, error code. */
+    TRACE_EVICT,                /* Frame's kernel and user addresses. */
+    TRACE_BLOCK_READ,           /* First sector, number of sectors. */
+    TRACE_BLOCK_WRITE,          /* First sector, number of sectors. */
+    TRACE_SYSCALL,              /* System call number, caller's eip. */
+    TRACE_EVENT_CNT
+  };
+
+extern bool trace_enabled;
+
+void trace_init (void);
+void trace_record (enum trace_event, uint32_t arg0, uint32_t arg1);
+void trace_dump (void);
+
+/* Records EVENT with arguments ARG0 and ARG1, if tracing is
+   enabled.  Otherwise, costs only a test of trace_enabled. */
+static inline void
+trace (enum trace_event event, uint32_t arg0, uint32_t arg1)
+{
+  if (trace_enabled)
+    trace_record (event, arg0, arg1);
+}
+
+#endif /* threads/trace.h */
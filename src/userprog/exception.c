@@ -4,7 +4,11 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -141,12 +145,33 @@ page_fault(struct intr_frame *f)
 
    /* Count page faults. */
    page_fault_cnt++;
+   trace(TRACE_PAGE_FAULT, (uint32_t)fault_addr, f->error_code);
 
    /* Determine cause. */
    not_present = (f->error_code & PF_P) == 0;
    write = (f->error_code & PF_W) != 0;
    user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+   /* Bring in a page that is not loaded yet, whether the user
+      program touched it or the kernel did on its behalf.  In the
+      latter case f->esp is the kernel's, so use the user stack
+      pointer saved on system call entry. */
+   if (not_present && is_user_vaddr(fault_addr)
+       && vm_page_fault(fault_addr, user ? f->esp : thread_current()->user_esp))
+      return;
+#endif
+
+   /* A kernel access to a user address faults only in get_user()
+      or put_user() in syscall.c, which load the address to resume
+      at into eax and take -1 in eax as failure. */
+   if (!user && is_user_vaddr(fault_addr))
+   {
+      f->eip = (void *)f->eax;
+      f->eax = 0xffffffff;
+      return;
+   }
+
    if (!user || is_kernel_vaddr(fault_addr) || not_present)
    {
       f->eip = (void *)f->eax;
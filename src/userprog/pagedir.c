@@ -5,6 +5,9 @@
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 static uint32_t *active_pd(void);
 static void invalidate_pagedir(uint32_t *);
@@ -40,7 +43,11 @@ void pagedir_destroy(uint32_t *pd)
 
       for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
         if (*pte & PTE_P)
+#ifdef VM
+          vm_unmap_frame(pte_get_page(*pte), pd);
+#else
           palloc_free_page(pte_get_page(*pte));
+#endif
       palloc_free_page(pt);
     }
   palloc_free_page(pd);
@@ -163,6 +170,15 @@ bool pagedir_is_dirty(uint32_t *pd, const void *vpage)
   return pte != NULL && (*pte & PTE_D) != 0;
 }
 
+/* Returns true if the PTE for virtual page VPAGE in PD allows
+   user writes.
+   Returns false if PD contains no PTE for VPAGE. */
+bool pagedir_is_writable(uint32_t *pd, const void *vpage)
+{
+  uint32_t *pte = lookup_page(pd, vpage, false);
+  return pte != NULL && (*pte & PTE_W) != 0;
+}
+
 /* Set the dirty bit to DIRTY in the PTE for virtual page VPAGE
    in PD. */
 void pagedir_set_dirty(uint32_t *pd, const void *vpage, bool dirty)
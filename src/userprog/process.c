@@ -18,6 +18,11 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "lib/user/syscall.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "userprog/syscall.h"
+#endif
 
 static thread_func start_process NO_RETURN;
 static bool load(const char *cmdline, void (**eip)(void), void **esp);
@@ -124,6 +129,13 @@ start_process(void *file_name_)
   struct intr_frame if_;
   bool success;
 
+  /* Start in the parent's working directory.  The parent waits
+     in process_execute() until we have loaded, so its working
+     directory cannot change under us. */
+  struct thread *cur = thread_current();
+  if (cur->parent->cwd != NULL)
+    cur->cwd = dir_reopen(cur->parent->cwd);
+
   /* Initialize interrupt frame and load executable. */
   memset(&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
@@ -153,7 +165,6 @@ start_process(void *file_name_)
   }
 
   success = load(token_array[0], &if_.eip, &if_.esp);
-  struct thread *cur = thread_current();
   if (success)
   {
     argument_stack(token_array, num_token, &if_.esp);
@@ -272,6 +283,11 @@ void process_exit(void)
   struct thread *cur = thread_current();
   uint32_t *pd;
 
+#ifdef VM
+  /* Write back memory-mapped files while the pages are mapped. */
+  syscall_munmap_all();
+#endif
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -286,14 +302,27 @@ void process_exit(void)
        that's been freed (and cleared). */
     cur->pagedir = NULL;
     pagedir_activate(NULL);
+#ifdef VM
+    vm_lock_eviction();
     pagedir_destroy(pd);
+    free_suppl_pt(&cur->suppl_page_table);
+    vm_unlock_eviction();
+#else
+    pagedir_destroy(pd);
+#endif
   }
+#ifdef VM
+  file_close(cur->exec_file);
+  cur->exec_file = NULL;
+#endif
 
   int fd;
   for (int i = 2; i < cur->next_fd; i++)
   {
     file_close(cur->fdt[i]);
   }
+  dir_close(cur->cwd);
+  cur->cwd = NULL;
 
   sema_up(&(cur->child_lock));
   sema_down(&(cur->memory_lock));
@@ -400,6 +429,15 @@ bool load(const char *file_name, void (**eip)(void), void **esp)
   t->pagedir = pagedir_create();
   if (t->pagedir == NULL)
     goto done;
+#ifdef VM
+  lock_init(&t->spt_lock);
+  if (!hash_init(&t->suppl_page_table, suppl_pt_hash, suppl_pt_less, NULL))
+  {
+    pagedir_destroy(t->pagedir);
+    t->pagedir = NULL;
+    goto done;
+  }
+#endif
   process_activate();
 
   /* Open executable file. */
@@ -487,13 +525,25 @@ bool load(const char *file_name, void (**eip)(void), void **esp)
 done:
   /* We arrive here whether the load is successful or not. */
 
+#ifdef VM
+  /* Pages are read from the executable as they are first
+     touched, so keep it open, and unmodified, while we run. */
+  if (success)
+  {
+    file_deny_write(file);
+    t->exec_file = file;
+    return success;
+  }
+#endif
   file_close(file);
   return success;
 }
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page(void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -552,6 +602,10 @@ validate_segment(const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, nothing is read here: each page is only recorded in
+   the supplemental page table and is read in by the page fault
+   handler the first time it is touched.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -562,6 +616,23 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
   ASSERT(pg_ofs(upage) == 0);
   ASSERT(ofs % PGSIZE == 0);
 
+#ifdef VM
+  while (read_bytes > 0 || zero_bytes > 0)
+  {
+    size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+    size_t page_zero_bytes = PGSIZE - page_read_bytes;
+
+    if (!suppl_pt_insert_file(file, ofs, upage, page_read_bytes,
+                              page_zero_bytes, writable))
+      return false;
+
+    read_bytes -= page_read_bytes;
+    zero_bytes -= page_zero_bytes;
+    ofs += page_read_bytes;
+    upage += PGSIZE;
+  }
+  return true;
+#else
   file_seek(file, ofs);
   while (read_bytes > 0 || zero_bytes > 0)
   {
@@ -597,6 +668,7 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
     upage += PGSIZE;
   }
   return true;
+#endif
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -604,6 +676,12 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack(void **esp)
 {
+#ifdef VM
+  if (!grow_stack(((uint8_t *)PHYS_BASE) - PGSIZE))
+    return false;
+  *esp = PHYS_BASE;
+  return true;
+#else
   uint8_t *kpage;
   bool success = false;
 
@@ -617,8 +695,10 @@ setup_stack(void **esp)
       palloc_free_page(kpage);
   }
   return success;
+#endif
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -637,3 +717,4 @@ install_page(void *upage, void *kpage, bool writable)
      address, then map our page there. */
   return (pagedir_get_page(t->pagedir, upage) == NULL && pagedir_set_page(t->pagedir, upage, kpage, writable));
 }
+#endif
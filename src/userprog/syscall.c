@@ -1,126 +1,475 @@
 #include "userprog/syscall.h"
+#include <debug.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include "devices/input.h"
+#include "devices/shutdown.h"
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#ifdef VM
+#include <round.h>
+#include "vm/frame.h"
+#include "vm/page.h"
+#endif
+
+/* Carries out a system call whose arguments, copied from the
+   user stack, are in ARGS.  Returns the value to pass back to
+   the user program in eax. */
+typedef uint32_t syscall_function(const uint32_t args[]);
+
+static syscall_function sys_halt, sys_exit, sys_exec, sys_wait,
+	sys_create, sys_remove, sys_open, sys_filesize, sys_read, sys_write,
+	sys_seek, sys_tell, sys_close, sys_sigaction, sys_sendsig, sys_yield,
+	sys_chdir, sys_mkdir, sys_readdir, sys_isdir, sys_inumber, sys_procstat,
+	sys_getdents, sys_uptime;
+#ifdef VM
+static syscall_function sys_mmap, sys_munmap;
+#endif
+
+/* A system call. */
+struct syscall
+{
+	const char *name;		/* Name, for statistics. */
+	size_t arg_cnt;			/* Number of 32-bit arguments. */
+	syscall_function *func; /* Implementation. */
+};
+
+/* System calls, indexed by number.  A number without an entry
+   kills the process that uses it. */
+static const struct syscall syscalls[] = {
+	[SYS_HALT] = {"halt", 0, sys_halt},
+	[SYS_EXIT] = {"exit", 1, sys_exit},
+	[SYS_EXEC] = {"exec", 1, sys_exec},
+	[SYS_WAIT] = {"wait", 1, sys_wait},
+	[SYS_CREATE] = {"create", 2, sys_create},
+	[SYS_REMOVE] = {"remove", 1, sys_remove},
+	[SYS_OPEN] = {"open", 1, sys_open},
+	[SYS_FILESIZE] = {"filesize", 1, sys_filesize},
+	[SYS_READ] = {"read", 3, sys_read},
+	[SYS_WRITE] = {"write", 3, sys_write},
+	[SYS_SEEK] = {"seek", 2, sys_seek},
+	[SYS_TELL] = {"tell", 1, sys_tell},
+	[SYS_CLOSE] = {"close", 1, sys_close},
+	[SYS_SIGACTION] = {"sigaction", 2, sys_sigaction},
+	[SYS_SENDSIG] = {"sendsig", 2, sys_sendsig},
+	[SYS_YIELD] = {"yield", 0, sys_yield},
+#ifdef VM
+	[SYS_MMAP] = {"mmap", 2, sys_mmap},
+	[SYS_MUNMAP] = {"munmap", 1, sys_munmap},
+#endif
+	[SYS_CHDIR] = {"chdir", 1, sys_chdir},
+	[SYS_MKDIR] = {"mkdir", 1, sys_mkdir},
+	[SYS_READDIR] = {"readdir", 2, sys_readdir},
+	[SYS_ISDIR] = {"isdir", 1, sys_isdir},
+	[SYS_INUMBER] = {"inumber", 1, sys_inumber},
+	[SYS_PROCSTAT] = {"procstat", 2, sys_procstat},
+	[SYS_GETDENTS] = {"getdents", 3, sys_getdents},
+	[SYS_UPTIME] = {"uptime", 0, sys_uptime},
+};
+
+/* Number of entries in syscalls[]. */
+#define SYSCALL_CNT (sizeof syscalls / sizeof *syscalls)
+
+/* Largest arg_cnt in syscalls[]. */
+#define SYSCALL_ARG_MAX 3
+
+/* Statistics, indexed by system call number. */
+static long long call_cnt[SYSCALL_CNT];	   /* Number of calls. */
+static long long call_cycles[SYSCALL_CNT]; /* CPU cycles in calls that returned. */
+
+#ifdef VM
+/* A memory-mapped file. */
+struct mmap_desc
+{
+	mapid_t id;			   /* Mapping identifier. */
+	struct file *file;	   /* File, reopened for the mapping. */
+	uint8_t *addr;		   /* First mapped page. */
+	size_t page_cnt;	   /* Number of mapped pages. */
+	struct list_elem elem; /* Element in thread's mmaps list. */
+};
+
+static void unmap_pages(struct mmap_desc *, size_t page_cnt);
+
+/* Most bytes of a read() or write() buffer pinned at once. */
+#define PIN_MAX (16 * PGSIZE)
 
-struct lock filesys_lock;
+static int pinned_io(int fd, uint8_t *ubuf, unsigned size, bool reading);
+static void pin_user_buffer(const void *ubuf, size_t size, bool writable);
+static void unpin_user_buffer(const void *ubuf, size_t size);
+#endif
 
 static void syscall_handler(struct intr_frame *);
+static int get_user(const uint8_t *uaddr);
+static bool put_user(uint8_t *udst, uint8_t byte);
+static void copy_in(void *dst, const void *usrc, size_t size);
+static char *copy_in_string(const char *us);
+static void check_user_buffer(const void *ubuf, size_t size, bool writable);
+static struct file *fd_to_file(int fd);
 
 void syscall_init(void)
 {
-	lock_init(&filesys_lock);
 	intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
+/* Prints system call statistics. */
+void syscall_print_stats(void)
+{
+	size_t i;
+
+	for (i = 0; i < SYSCALL_CNT; i++)
+		if (call_cnt[i] > 0)
+			printf("Syscall: %lld %s calls, %lld cycles\n",
+				   call_cnt[i], syscalls[i].name, call_cycles[i]);
+}
+
 static void
-syscall_handler(struct intr_frame *f UNUSED)
+syscall_handler(struct intr_frame *f)
 {
-	switch (*(uint32_t *)(f->esp))
+	uint64_t start = rdtsc();
+	const struct syscall *sc;
+	uint32_t nr, args[SYSCALL_ARG_MAX];
+
+#ifdef VM
+	/* Page faults in the kernel need the user stack pointer to
+	   recognize stack accesses. */
+	thread_current()->user_esp = f->esp;
+#endif
+	copy_in(&nr, f->esp, sizeof nr);
+	trace(TRACE_SYSCALL, nr, (uint32_t)f->eip);
+	if (nr >= SYSCALL_CNT || syscalls[nr].func == NULL)
+		exit(-1);
+	sc = &syscalls[nr];
+	call_cnt[nr]++;
+
+	copy_in(args, (uint32_t *)f->esp + 1, sc->arg_cnt * sizeof *args);
+	f->eax = sc->func(args);
+	call_cycles[nr] += rdtsc() - start;
+}
+
+/* Reads a byte at user virtual address UADDR, which must be
+   below PHYS_BASE.  Returns the byte value if successful, -1 if
+   a page fault occurred.  The page fault handler recovers from
+   a fault here by resuming at the address loaded into eax, with
+   eax set to -1, so no page table walk is needed up front. */
+static int
+get_user(const uint8_t *uaddr)
+{
+	int result;
+	asm("movl $1f, %0; movzbl %1, %0; 1:"
+		: "=&a"(result)
+		: "m"(*uaddr));
+	return result;
+}
+
+/* Writes BYTE to user address UDST, which must be below
+   PHYS_BASE.  Returns true if successful, false if a page fault
+   occurred. */
+static bool
+put_user(uint8_t *udst, uint8_t byte)
+{
+	int error_code;
+	asm("movl $1f, %0; movb %b2, %1; 1:"
+		: "=&a"(error_code), "=m"(*udst)
+		: "q"(byte));
+	return error_code != -1;
+}
+
+/* Returns true if the SIZE bytes starting at UADDR all lie
+   below PHYS_BASE. */
+static bool
+is_user_range(const void *uaddr, size_t size)
+{
+	uintptr_t start = (uintptr_t)uaddr;
+	return start + size >= start && start + size <= (uintptr_t)PHYS_BASE;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Kills the process if any of the bytes is not in mapped
+   user memory. */
+static void
+copy_in(void *dst_, const void *usrc_, size_t size)
+{
+	uint8_t *dst = dst_;
+	const uint8_t *usrc = usrc_;
+
+	if (!is_user_range(usrc, size))
+		exit(-1);
+	for (; size > 0; size--)
 	{
-	case SYS_HALT:
-		halt();
-		break;
-
-	case SYS_EXIT:
-		validate_user_vaddr(f->esp + 4);
-		exit(*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_EXEC:
-		validate_user_vaddr(f->esp + 4);
-		f->eax = exec((const char *)*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_WAIT:
-		validate_user_vaddr(f->esp + 4);
-		f->eax = wait((pid_t *)*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_CREATE:
-		validate_user_vaddr(f->esp + 4);
-		validate_user_vaddr(f->esp + 8);
-		f->eax = create((const char *)*(uint32_t *)(f->esp + 4), (unsigned)*(uint32_t *)(f->esp + 8));
-		break;
-
-	case SYS_REMOVE:
-		validate_user_vaddr(f->esp + 4);
-		f->eax = remove((const char *)*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_OPEN:
-		validate_user_vaddr(f->esp + 4);
-		f->eax = open((const char *)*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_FILESIZE:
-		validate_user_vaddr(f->esp + 4);
-		f->eax = filesize((int)*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_READ:
-		validate_user_vaddr(f->esp + 4);
-		validate_user_vaddr(f->esp + 8);
-		validate_user_vaddr(f->esp + 12);
-		f->eax = read((int)*(uint32_t *)(f->esp + 4), (void *)*(uint32_t *)(f->esp + 8), (unsigned)*(uint32_t *)(f->esp + 12));
-		break;
-
-	case SYS_WRITE:
-		validate_user_vaddr(f->esp + 4);
-		validate_user_vaddr(f->esp + 8);
-		validate_user_vaddr(f->esp + 12);
-		f->eax = write((int)*(uint32_t *)(f->esp + 4), (void *)*(uint32_t *)(f->esp + 8), (unsigned)*((uint32_t *)(f->esp + 12)));
-		break;
-
-	case SYS_SEEK:
-		validate_user_vaddr(f->esp + 4);
-		validate_user_vaddr(f->esp + 8);
-		seek((int)*(uint32_t *)(f->esp + 4), (unsigned)*(uint32_t *)(f->esp + 8));
-		break;
-
-	case SYS_TELL:
-		validate_user_vaddr(f->esp + 4);
-		f->eax = tell((int)*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_CLOSE:
-		validate_user_vaddr(f->esp + 4);
-		close((int)*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_SIGACTION:
-		validate_user_vaddr(f->esp + 4);
-		validate_user_vaddr(f->esp + 8);
-
-		sigaction((int)*(uint32_t *)(f->esp + 4), (void *)*(uint32_t *)(f->esp + 8));
-
-		break;
-
-	case SYS_SENDSIG:
-		validate_user_vaddr(f->esp + 4);
-		validate_user_vaddr(f->esp + 8);
-
-		sendsig((pid_t) * (uint32_t *)(f->esp + 4), (int)*(uint32_t *)(f->esp + 8));
-
-		break;
-
-	case SYS_YIELD:
-		thread_yield();
-		break;
+		int byte = get_user(usrc++);
+		if (byte == -1)
+			exit(-1);
+		*dst++ = byte;
 	}
 }
 
-void validate_user_vaddr(const void *vaddr)
+/* Copies the null-terminated string at user address US into a
+   new page, truncating it to PGSIZE - 1 characters, and returns
+   the page, which the caller must free with palloc_free_page().
+   Kills the process if the string is not in mapped user memory
+   or no page is available. */
+static char *
+copy_in_string(const char *us)
 {
-	if (!is_user_vaddr(vaddr) || vaddr == NULL)
+	char *ks = palloc_get_page(0);
+	size_t i;
+
+	if (ks == NULL)
+		exit(-1);
+	for (i = 0; i < PGSIZE; i++)
 	{
+		int c = is_user_vaddr(us + i) ? get_user((const uint8_t *)us + i) : -1;
+		if (c == -1)
+		{
+			palloc_free_page(ks);
+			exit(-1);
+		}
+		ks[i] = c;
+		if (c == '\0')
+			return ks;
+	}
+	ks[PGSIZE - 1] = '\0';
+	return ks;
+}
+
+/* Kills the process unless the SIZE bytes at user address UBUF
+   are in mapped user memory that is also writable if WRITABLE
+   is true.  Touches one byte per page instead of checking each
+   byte. */
+static void
+check_user_buffer(const void *ubuf, size_t size, bool writable)
+{
+	uint8_t *p = (uint8_t *)ubuf;
+	uint8_t *end = p + size;
+
+	if (!is_user_range(ubuf, size))
 		exit(-1);
+	for (; p < end; p = (uint8_t *)pg_round_down(p) + PGSIZE)
+	{
+		int byte = get_user(p);
+		if (byte == -1 || (writable && !put_user(p, byte)))
+			exit(-1);
 	}
 }
 
+static uint32_t
+sys_halt(const uint32_t args[] UNUSED)
+{
+	halt();
+	NOT_REACHED();
+}
+
+static uint32_t
+sys_exit(const uint32_t args[])
+{
+	exit((int)args[0]);
+	NOT_REACHED();
+}
+
+static uint32_t
+sys_exec(const uint32_t args[])
+{
+	char *command = copy_in_string((const char *)args[0]);
+	pid_t pid = exec(command);
+
+	palloc_free_page(command);
+	return pid;
+}
+
+static uint32_t
+sys_wait(const uint32_t args[])
+{
+	return wait((pid_t)args[0]);
+}
+
+static uint32_t
+sys_create(const uint32_t args[])
+{
+	char *file = copy_in_string((const char *)args[0]);
+	bool success = create(file, (unsigned)args[1]);
+
+	palloc_free_page(file);
+	return success;
+}
+
+static uint32_t
+sys_remove(const uint32_t args[])
+{
+	char *file = copy_in_string((const char *)args[0]);
+	bool success = remove(file);
+
+	palloc_free_page(file);
+	return success;
+}
+
+static uint32_t
+sys_open(const uint32_t args[])
+{
+	char *file = copy_in_string((const char *)args[0]);
+	int fd = open(file);
+
+	palloc_free_page(file);
+	return fd;
+}
+
+static uint32_t
+sys_filesize(const uint32_t args[])
+{
+	return filesize((int)args[0]);
+}
+
+static uint32_t
+sys_read(const uint32_t args[])
+{
+	check_user_buffer((void *)args[1], args[2], true);
+#ifdef VM
+	return pinned_io((int)args[0], (uint8_t *)args[1], args[2], true);
+#else
+	return read((int)args[0], (void *)args[1], (unsigned)args[2]);
+#endif
+}
+
+static uint32_t
+sys_write(const uint32_t args[])
+{
+	check_user_buffer((const void *)args[1], args[2], false);
+#ifdef VM
+	return pinned_io((int)args[0], (uint8_t *)args[1], args[2], false);
+#else
+	return write((int)args[0], (const void *)args[1], (unsigned)args[2]);
+#endif
+}
+
+static uint32_t
+sys_seek(const uint32_t args[])
+{
+	seek((int)args[0], (unsigned)args[1]);
+	return 0;
+}
+
+static uint32_t
+sys_tell(const uint32_t args[])
+{
+	return tell((int)args[0]);
+}
+
+static uint32_t
+sys_close(const uint32_t args[])
+{
+	close((int)args[0]);
+	return 0;
+}
+
+static uint32_t
+sys_sigaction(const uint32_t args[])
+{
+	sigaction((int)args[0], (void (*)(void))args[1]);
+	return 0;
+}
+
+static uint32_t
+sys_sendsig(const uint32_t args[])
+{
+	sendsig((pid_t)args[0], (int)args[1]);
+	return 0;
+}
+
+static uint32_t
+sys_yield(const uint32_t args[] UNUSED)
+{
+	thread_yield();
+	return 0;
+}
+
+static uint32_t
+sys_chdir(const uint32_t args[])
+{
+	char *dir = copy_in_string((const char *)args[0]);
+	bool success = chdir(dir);
+
+	palloc_free_page(dir);
+	return success;
+}
+
+static uint32_t
+sys_mkdir(const uint32_t args[])
+{
+	char *dir = copy_in_string((const char *)args[0]);
+	bool success = mkdir(dir);
+
+	palloc_free_page(dir);
+	return success;
+}
+
+static uint32_t
+sys_readdir(const uint32_t args[])
+{
+	check_user_buffer((void *)args[1], READDIR_MAX_LEN + 1, true);
+	return readdir((int)args[0], (char *)args[1]);
+}
+
+static uint32_t
+sys_isdir(const uint32_t args[])
+{
+	return isdir((int)args[0]);
+}
+
+static uint32_t
+sys_inumber(const uint32_t args[])
+{
+	return inumber((int)args[0]);
+}
+
+static uint32_t
+sys_procstat(const uint32_t args[])
+{
+	check_user_buffer((void *)args[1], sizeof(struct procstat), true);
+	return procstat((pid_t)args[0], (struct procstat *)args[1]);
+}
+
+static uint32_t
+sys_getdents(const uint32_t args[])
+{
+	if (args[2] > SIZE_MAX / sizeof(struct dirent))
+		exit(-1);
+	check_user_buffer((void *)args[1], args[2] * sizeof(struct dirent), true);
+	return getdents((int)args[0], (struct dirent *)args[1], (unsigned)args[2]);
+}
+
+static uint32_t
+sys_uptime(const uint32_t args[] UNUSED)
+{
+	return uptime();
+}
+
+#ifdef VM
+static uint32_t
+sys_mmap(const uint32_t args[])
+{
+	return mmap((int)args[0], (void *)args[1]);
+}
+
+static uint32_t
+sys_munmap(const uint32_t args[])
+{
+	munmap((mapid_t)args[0]);
+	return 0;
+}
+#endif
+
 void halt(void)
 {
 	shutdown_power_off();
@@ -151,11 +500,7 @@ void exit(int status)
 
 pid_t exec(const char *command)
 {
-	char *file_name[128];
-	memcpy(file_name, command, strlen(command) + 1);
-	pid_t pid = process_execute(file_name);
-
-	return pid;
+	return process_execute(command);
 }
 
 int wait(pid_t pid)
@@ -165,28 +510,18 @@ int wait(pid_t pid)
 
 bool create(const char *file, unsigned initial_size)
 {
-	if (file == NULL)
-		exit(-1);
 	return filesys_create(file, initial_size);
 }
 
 bool remove(const char *file)
 {
-	if (file == NULL)
-		exit(-1);
 	return filesys_remove(file);
 }
 
 int open(const char *file)
 {
 	struct thread *cur = thread_current();
-	int fd;
-
-	if (file == NULL)
-		exit(-1);
-	lock_acquire(&filesys_lock);
 	struct file *open_file = filesys_open(file);
-	lock_release(&filesys_lock);
 	if (open_file == NULL)
 	{
 		return -1;
@@ -208,8 +543,7 @@ int open(const char *file)
 
 int filesize(int fd)
 {
-
-	struct file *file = thread_current()->fdt[fd];
+	struct file *file = fd_to_file(fd);
 	if (file == NULL)
 		return -1;
 	off_t length = file_length(file);
@@ -218,9 +552,7 @@ int filesize(int fd)
 
 int read(int fd, void *buffer, unsigned size)
 {
-	validate_user_vaddr(buffer);
 	int return_val;
-	lock_acquire(&filesys_lock);
 	if (fd == 0)
 	{
 		int count = 0;
@@ -233,21 +565,16 @@ int read(int fd, void *buffer, unsigned size)
 	}
 	else
 	{
-		struct file *file = thread_current()->fdt[fd];
-		if (file == NULL)
-		{
-			lock_release(&filesys_lock);
+		struct file *file = fd_to_file(fd);
+		if (file == NULL || inode_is_dir(file_get_inode(file)))
 			return -1;
-		}
 		return_val = file_read(file, buffer, size);
 	}
-	lock_release(&filesys_lock);
 	return return_val;
 }
 
 int write(int fd, const void *buffer, unsigned size)
 {
-	lock_acquire(&filesys_lock);
 	int return_val = -1;
 	if (fd == 1)
 	{
@@ -257,21 +584,17 @@ int write(int fd, const void *buffer, unsigned size)
 
 	else
 	{
-		struct file *f_path = thread_current()->fdt[fd];
-		if (f_path == NULL)
-		{
-			lock_release(&filesys_lock);
+		struct file *f_path = fd_to_file(fd);
+		if (f_path == NULL || inode_is_dir(file_get_inode(f_path)))
 			return -1;
-		}
 		return_val = file_write(f_path, buffer, size);
 	}
-	lock_release(&filesys_lock);
 	return return_val;
 }
 
 void seek(int fd, unsigned position)
 {
-	struct file *f_path = thread_current()->fdt[fd];
+	struct file *f_path = fd_to_file(fd);
 	if (f_path == NULL)
 	{
 		return;
@@ -281,7 +604,7 @@ void seek(int fd, unsigned position)
 
 unsigned tell(int fd)
 {
-	struct file *f_path = thread_current()->fdt[fd];
+	struct file *f_path = fd_to_file(fd);
 	if (f_path == NULL)
 	{
 		return -1;
@@ -291,7 +614,7 @@ unsigned tell(int fd)
 
 void close(int fd)
 {
-	struct file *f_path = thread_current()->fdt[fd];
+	struct file *f_path = fd_to_file(fd);
 	if (f_path == NULL)
 	{
 		return;
@@ -324,3 +647,307 @@ void sendsig(pid_t pid, int signum)
 {
 	sendsig_thread(pid, signum);
 }
+
+/* Copies the CPU accounting of process PID into STAT.  Returns
+   false if there is no such process. */
+bool procstat(pid_t pid, struct procstat *stat)
+{
+	struct procstat buf;
+	struct thread *t;
+	enum intr_level old_level;
+
+	old_level = intr_disable();
+	t = pid != TID_ERROR ? thread_get_by_id(pid) : NULL;
+	if (t != NULL)
+	{
+		buf.user_ticks = t->user_ticks;
+		buf.kernel_ticks = t->kernel_ticks;
+		buf.voluntary_switches = t->voluntary_switches;
+		buf.involuntary_switches = t->involuntary_switches;
+		buf.wait_ticks = t->wait_ticks;
+		buf.max_wait_ticks = t->max_wait_ticks;
+	}
+	intr_set_level(old_level);
+
+	if (t == NULL)
+		return false;
+	memcpy(stat, &buf, sizeof buf);
+	return true;
+}
+
+/* Returns the file open as FD in the current process, or a null
+   pointer if FD is not open. */
+static struct file *
+fd_to_file(int fd)
+{
+	if (fd < 2 || fd >= 64)
+		return NULL;
+	return thread_current()->fdt[fd];
+}
+
+/* Changes the current working directory to DIR.  Returns true
+   if successful, false if DIR is not a directory. */
+bool chdir(const char *dir)
+{
+	return filesys_chdir(dir);
+}
+
+/* Creates the directory DIR.  Returns true if successful, false
+   if DIR already exists or its parent does not. */
+bool mkdir(const char *dir)
+{
+	return filesys_mkdir(dir);
+}
+
+/* Reads the next entry of the directory open as FD into NAME.
+   Returns false if FD is not a directory or has no more
+   entries.  "." and ".." are never returned. */
+bool readdir(int fd, char name[READDIR_MAX_LEN + 1])
+{
+	struct file *file = fd_to_file(fd);
+	struct dir *dir;
+	bool success;
+
+	if (file == NULL || !inode_is_dir(file_get_inode(file)))
+		return false;
+
+	/* The file position is the directory position. */
+	dir = dir_open(inode_reopen(file_get_inode(file)));
+	if (dir == NULL)
+		return false;
+	dir_seek(dir, file_tell(file));
+	success = dir_readdir(dir, name);
+	file_seek(file, dir_tell(dir));
+	dir_close(dir);
+	return success;
+}
+
+/* Reads up to CNT entries of the directory open as FD into
+   ENTRIES, continuing where the last readdir() or getdents() on
+   FD left off.  Returns the number of entries read, 0 at the end
+   of the directory, or -1 if FD is not a directory. */
+int getdents(int fd, struct dirent *entries, unsigned cnt)
+{
+	struct file *file = fd_to_file(fd);
+	struct dir_info *info;
+	struct dir *dir;
+	size_t batch, n, i;
+	unsigned total = 0;
+
+	if (file == NULL || !inode_is_dir(file_get_inode(file)))
+		return -1;
+	info = palloc_get_page(0);
+	dir = dir_open(inode_reopen(file_get_inode(file)));
+	if (info == NULL || dir == NULL)
+	{
+		palloc_free_page(info);
+		dir_close(dir);
+		return -1;
+	}
+
+	/* The file position is the directory position. */
+	dir_seek(dir, file_tell(file));
+	batch = PGSIZE / sizeof *info;
+	while (total < cnt)
+	{
+		n = dir_read_entries(dir, info, cnt - total < batch ? cnt - total : batch);
+		if (n == 0)
+			break;
+		for (i = 0; i < n; i++, total++)
+		{
+			struct dirent *d = &entries[total];
+			d->inumber = info[i].inode_sector;
+			d->size = info[i].length;
+			d->is_dir = info[i].is_dir;
+			strlcpy(d->name, info[i].name, sizeof d->name);
+		}
+	}
+	file_seek(file, dir_tell(dir));
+
+	dir_close(dir);
+	palloc_free_page(info);
+	return total;
+}
+
+/* Returns the number of timer ticks since the OS booted. */
+int uptime(void)
+{
+	return timer_ticks();
+}
+
+/* Returns true if FD is an open directory. */
+bool isdir(int fd)
+{
+	struct file *file = fd_to_file(fd);
+	return file != NULL && inode_is_dir(file_get_inode(file));
+}
+
+/* Returns the inode number of the file or directory open as FD,
+   or -1 if FD is not open. */
+int inumber(int fd)
+{
+	struct file *file = fd_to_file(fd);
+	return file != NULL ? (int)inode_get_inumber(file_get_inode(file)) : -1;
+}
+
+#ifdef VM
+/* Maps the file open as FD into the current process at ADDR,
+   which must be page-aligned.  Nothing is read now: each page
+   is read in by the page fault handler when it is first
+   touched.  Returns the new mapping's identifier, or MAP_FAILED
+   if FD is not an open file, the file is empty, or the mapping
+   would overlap pages already in use. */
+mapid_t mmap(int fd, void *addr)
+{
+	struct thread *cur = thread_current();
+	struct file *file = fd_to_file(fd);
+	struct mmap_desc *m;
+	off_t length;
+	size_t i;
+
+	if (file == NULL || inode_is_dir(file_get_inode(file)))
+		return MAP_FAILED;
+	if (addr == NULL || pg_ofs(addr) != 0)
+		return MAP_FAILED;
+	length = file_length(file);
+	if (length == 0 || !is_user_range(addr, length))
+		return MAP_FAILED;
+
+	m = malloc(sizeof *m);
+	if (m == NULL)
+		return MAP_FAILED;
+	m->file = file_reopen(file);
+	if (m->file == NULL)
+	{
+		free(m);
+		return MAP_FAILED;
+	}
+	m->addr = addr;
+	m->page_cnt = DIV_ROUND_UP(length, PGSIZE);
+
+	for (i = 0; i < m->page_cnt; i++)
+	{
+		uint8_t *upage = m->addr + i * PGSIZE;
+		off_t ofs = i * PGSIZE;
+		uint32_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+		/* Pages with supplemental entries are refused by
+		   suppl_pt_insert_mmf(), which leaves stack pages that
+		   have never been evicted. */
+		if (pagedir_get_page(cur->pagedir, upage) != NULL
+			|| !suppl_pt_insert_mmf(m->file, ofs, upage, read_bytes))
+		{
+			unmap_pages(m, i);
+			file_close(m->file);
+			free(m);
+			return MAP_FAILED;
+		}
+	}
+
+	m->id = cur->next_mapid++;
+	list_push_back(&cur->mmaps, &m->elem);
+	return m->id;
+}
+
+/* Unmaps MAPPING, writing the pages the process modified back to
+   the file.  Does nothing if MAPPING is not one of the current
+   process's mappings. */
+void munmap(mapid_t mapping)
+{
+	struct thread *cur = thread_current();
+	struct list_elem *e;
+
+	for (e = list_begin(&cur->mmaps); e != list_end(&cur->mmaps);
+		 e = list_next(e))
+	{
+		struct mmap_desc *m = list_entry(e, struct mmap_desc, elem);
+		if (m->id == mapping)
+		{
+			list_remove(&m->elem);
+			unmap_pages(m, m->page_cnt);
+			file_close(m->file);
+			free(m);
+			return;
+		}
+	}
+}
+
+/* Unmaps all of the current process's mappings.  Called when the
+   process exits, before its page directory is destroyed. */
+void syscall_munmap_all(void)
+{
+	struct thread *cur = thread_current();
+
+	while (!list_empty(&cur->mmaps))
+		munmap(list_entry(list_front(&cur->mmaps), struct mmap_desc, elem)->id);
+}
+
+/* Removes the first PAGE_CNT pages of mapping M from the current
+   process. */
+static void
+unmap_pages(struct mmap_desc *m, size_t page_cnt)
+{
+	size_t i;
+
+	for (i = 0; i < page_cnt; i++)
+		suppl_pt_remove_mmf(m->addr + i * PGSIZE);
+}
+
+/* Reads (if READING is true) or writes SIZE bytes between FD and
+   the user buffer UBUF, which has been checked, and returns the
+   number of bytes transferred or -1 as read() or write() does.
+   The buffer's pages are pinned while the file system uses them,
+   at most PIN_MAX bytes at a time so that a large buffer cannot
+   pin every frame.  A fault in the file system could deadlock,
+   because it holds cache and inode locks that the evictor may
+   need to write back a page of a mapped file. */
+static int
+pinned_io(int fd, uint8_t *ubuf, unsigned size, bool reading)
+{
+	unsigned done = 0;
+
+	do
+	{
+		unsigned chunk = size - done < PIN_MAX ? size - done : PIN_MAX;
+		int n;
+
+		pin_user_buffer(ubuf + done, chunk, reading);
+		n = reading ? read(fd, ubuf + done, chunk)
+					: write(fd, ubuf + done, chunk);
+		unpin_user_buffer(ubuf + done, chunk);
+		if (n < 0)
+			return done > 0 ? (int)done : n;
+		done += n;
+		if ((unsigned)n < chunk)
+			break;
+	} while (done < size);
+	return done;
+}
+
+/* Loads and pins the pages of the SIZE bytes at user address
+   UBUF, which must be writable if WRITABLE is true.  Kills the
+   process if they are not valid user memory. */
+static void
+pin_user_buffer(const void *ubuf, size_t size, bool writable)
+{
+	uint8_t *p;
+
+	if (size == 0)
+		return;
+	for (p = pg_round_down(ubuf); p < (uint8_t *)ubuf + size; p += PGSIZE)
+		while (!vm_pin_page(p))
+			check_user_buffer(p, 1, writable);
+}
+
+/* Unpins the pages pinned by pin_user_buffer(UBUF, SIZE). */
+static void
+unpin_user_buffer(const void *ubuf, size_t size)
+{
+	uint8_t *p;
+
+	if (size == 0)
+		return;
+	for (p = pg_round_down(ubuf); p < (uint8_t *)ubuf + size; p += PGSIZE)
+		vm_unpin_page(p);
+}
+#endif
@@ -4,7 +4,9 @@
 #include "lib/user/syscall.h"
 
 void syscall_init(void);
-
-extern struct lock filesys_lock;
+void syscall_print_stats(void);
+#ifdef VM
+void syscall_munmap_all(void);
+#endif
 
 #endif /* userprog/syscall.h */
@@ -3,20 +3,59 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/pte.h"
-#include "lib/kernel/list.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
 #include "userprog/pagedir.h"
 #include "vm/frame.h"
 
-struct list vm_frames;  
+/* Frame table, indexed by palloc_user_page_idx(). */
+static struct vm_frame *vm_frames;
+static size_t vm_frame_cnt;
+static size_t used_frame_cnt;   /* Number of entries in use. */
 
 static struct lock vm_lock;
 
+/* Shared frames holding read-only file pages, keyed by inode and
+   offset.  Protected by vm_lock. */
+static struct hash shared_frames;
+static hash_hash_func shared_frame_hash;
+static hash_less_func shared_frame_less;
+
+/* Next frame table entry the clock hand will consider. */
+static size_t clock_hand;
+
 static struct lock eviction_lock;
 
+/* Pageout daemon.  When fewer than low_water frames are free,
+   the daemon evicts frames in the background, saving their
+   contents to swap or their file, until high_water frames are
+   free again.  Pages bound for swap are written in batches of
+   up to SWAP_BATCH_MAX to adjacent slots, each batch in a single
+   request.  The frames it evicts go on a reserve stack, from
+   which vm_allocate_frame() takes a frame without searching or
+   waiting for I/O. */
+static size_t low_water, high_water;
+static size_t *reserve;         /* Indexes of reserved frames. */
+static size_t reserve_cnt;      /* Number of reserved frames. */
+static bool pageout_requested;  /* Daemon signaled but not yet run? */
+static struct semaphore pageout_sema;
+
+/* Statistics. */
+static long long reserve_alloc_cnt;     /* Frames taken from reserve. */
+static long long pool_alloc_cnt;        /* Frames taken from palloc. */
+static long long sync_evict_cnt;        /* Synchronous evictions. */
+static long long sync_evict_ticks;      /* Time spent in them. */
+static long long pageout_cnt;           /* Frames evicted by daemon. */
+
+static thread_func pageout_daemon NO_RETURN;
+static void *take_reserved_frame (void);
+static void wake_pageout_daemon (void);
+
 static bool add_vm_frame (void *);
 
 static void remove_vm_frame (void *);
@@ -25,12 +64,61 @@ static struct vm_frame *get_vm_frame (void *);
 
 static struct vm_frame *frame_to_evict (void); 
 
+/* Outcome of begin_eviction(). */
+enum evict_state
+  {
+    EVICT_FAILED,               /* Frame could not be evicted. */
+    EVICT_SAVED,                /* Frame is free to reuse. */
+    EVICT_SWAP                  /* Frame must still go to swap. */
+  };
+
+/* A frame being evicted, between begin_eviction() and
+   finish_eviction(). */
+struct swap_victim
+  {
+    struct vm_frame *vf;        /* The frame. */
+    struct suppl_pte *spte;     /* Its page's supplemental PTE. */
+    bool created;               /* SPTE was created to evict it? */
+    bool dirty;                 /* PTE's dirty bit when unmapped. */
+    bool writable;              /* PTE's writable bit when unmapped. */
+  };
+
+static enum evict_state begin_eviction (struct vm_frame *,
+                                        struct swap_victim *);
+static void finish_eviction (struct swap_victim *, size_t swap_slot_idx);
 static bool save_evicted_frame (struct vm_frame *);
+static void write_swap_batch (struct swap_victim[], size_t cnt);
+static void reserve_evicted_frame (struct vm_frame *);
 
 void vm_frame_init () {
-  list_init (&vm_frames); 
+  size_t i;
+
+  vm_frame_cnt = palloc_user_page_cnt ();
+  vm_frames = calloc (vm_frame_cnt, sizeof *vm_frames);
+  if (vm_frames == NULL && vm_frame_cnt > 0)
+    PANIC ("can't allocate frame table");
+  for (i = 0; i < vm_frame_cnt; i++)
+    {
+      vm_frames[i].frame = palloc_user_page (i);
+      list_init (&vm_frames[i].sharers);
+    }
+  used_frame_cnt = 0;
+
   lock_init (&vm_lock);   
+  if (!hash_init (&shared_frames, shared_frame_hash, shared_frame_less, NULL))
+    PANIC ("can't allocate shared frame table");
   lock_init (&eviction_lock); 
+
+  low_water = vm_frame_cnt / 32 > 4 ? vm_frame_cnt / 32 : 4;
+  high_water = 2 * low_water;
+  if (high_water > vm_frame_cnt / 2)
+    high_water = low_water = 0;
+  reserve = malloc (high_water * sizeof *reserve);
+  reserve_cnt = 0;
+  pageout_requested = false;
+  sema_init (&pageout_sema, 0);
+  if (high_water > 0)
+    thread_create ("pageout", PRI_DEFAULT, pageout_daemon, NULL);
 }
 
 void *vm_allocate_frame(enum palloc_flags flags) {
@@ -38,18 +126,40 @@ void *vm_allocate_frame(enum palloc_flags flags) {
 
   if (flags & PAL_USER)
     {
-      if (flags & PAL_ZERO)
-        frame = palloc_get_page (PAL_USER | PAL_ZERO);
-      else
-        frame = palloc_get_page (PAL_USER);
+      /* Reserved frames were zeroed when they were evicted. */
+      frame = take_reserved_frame ();
+      if (frame == NULL)
+        frame = vm_try_allocate_frame (flags);
     }
 
-  if (frame != NULL)
-    add_vm_frame (frame);
-  else 
-    if ((frame = evict_frame ()) == NULL)
-      PANIC ("Evicting frame failed");  
+  if (frame == NULL)
+    {
+      int64_t start = timer_ticks ();
+      if ((frame = evict_frame ()) == NULL)
+        PANIC ("Evicting frame failed");  
+      sync_evict_cnt++;
+      sync_evict_ticks += timer_elapsed (start);
+    }
+
+  wake_pageout_daemon ();
+  return frame;
+}
+
+/* Allocates a frame from the free pool, without touching the
+   reserve or evicting anything.  Returns a null pointer if no
+   frame is free.  For speculative uses such as prefetching. */
+void *vm_try_allocate_frame (enum palloc_flags flags) {
+  void *frame;
 
+  if (flags & PAL_ZERO)
+    frame = palloc_get_page (PAL_USER | PAL_ZERO);
+  else
+    frame = palloc_get_page (PAL_USER);
+  if (frame != NULL)
+    {
+      add_vm_frame (frame);
+      pool_alloc_cnt++;
+    }
   return frame;
 }
 
@@ -58,14 +168,261 @@ void vm_free_frame (void *frame) {
   palloc_free_page (frame); 
 }
 
-void frame_set_usr (void *frame, uint32_t *pte, void *upage) {
+/* Removes the mapping of FRAME in page directory PAGEDIR, which
+   is being destroyed, and frees FRAME if nothing else maps it.
+   FRAME need not have come from vm_allocate_frame(). */
+void vm_unmap_frame (void *frame, uint32_t *pagedir) {
+  struct vm_frame *vf = &vm_frames[palloc_user_page_idx (frame)];
+  bool release = true;
+
+  lock_acquire (&vm_lock);
+  if (vf->in_use && vf->inode != NULL)
+    {
+      struct list_elem *e;
+
+      for (e = list_begin (&vf->sharers); e != list_end (&vf->sharers);
+           e = list_next (e))
+        {
+          struct frame_sharer *s = list_entry (e, struct frame_sharer, elem);
+          if (s->pagedir == pagedir)
+            {
+              list_remove (&s->elem);
+              free (s);
+              break;
+            }
+        }
+      release = list_empty (&vf->sharers);
+      if (release)
+        {
+          hash_delete (&shared_frames, &vf->share_elem);
+          vf->inode = NULL;
+        }
+    }
+  lock_release (&vm_lock);
+
+  if (!release)
+    return;
+  if (vf->in_use)
+    vm_free_frame (frame);
+  else
+    palloc_free_page (frame);
+}
+
+/* Maps the current process's UPAGE read-only to the shared frame
+   that holds the page at offset OFS in INODE.  Returns the frame,
+   or a null pointer if no frame holds that page or memory is
+   short.  The mapping is made before the process is added to the
+   frame's sharers, both under vm_lock, so the frame cannot be
+   evicted and reused while it is only half mapped. */
+void *vm_share_lookup (struct inode *inode, off_t ofs, void *upage) {
+  struct vm_frame key;
+  struct hash_elem *e;
+  struct frame_sharer *s;
+  void *frame = NULL;
+
+  s = malloc (sizeof *s);
+  if (s == NULL)
+    return NULL;
+  s->thread = thread_current ();
+  s->pagedir = thread_current ()->pagedir;
+  s->upage = upage;
+
+  key.inode = inode;
+  key.ofs = ofs;
+  lock_acquire (&vm_lock);
+  e = hash_find (&shared_frames, &key.share_elem);
+  if (e != NULL)
+    {
+      struct vm_frame *vf = hash_entry (e, struct vm_frame, share_elem);
+      if (pagedir_set_page (s->pagedir, upage, vf->frame, false))
+        {
+          list_push_back (&vf->sharers, &s->elem);
+          frame = vf->frame;
+        }
+    }
+  lock_release (&vm_lock);
+
+  if (frame == NULL)
+    free (s);
+  return frame;
+}
+
+/* Maps the current process's UPAGE read-only to FRAME, which the
+   process has just filled with the page at offset OFS in INODE,
+   and makes FRAME available for other processes to share.
+   Returns the frame that UPAGE now maps, or a null pointer if
+   memory is short.  If another process registered the same page
+   first, UPAGE maps the other process's frame instead.  Unless
+   FRAME is returned, the caller should free it.  If there is no
+   memory to share FRAME, it is mapped as a private frame. */
+void *vm_share_register (void *frame, struct inode *inode, off_t ofs,
+                         void *upage) {
+  struct vm_frame *vf = &vm_frames[palloc_user_page_idx (frame)];
+  uint32_t *pagedir = thread_current ()->pagedir;
+  struct frame_sharer *s;
+  struct hash_elem *old;
+  void *mapped = NULL;
+
+  s = malloc (sizeof *s);
+  if (s == NULL)
+    {
+      if (!pagedir_set_page (pagedir, upage, frame, false))
+        return NULL;
+      frame_set_usr (frame, upage);
+      return frame;
+    }
+
+  s->thread = thread_current ();
+  s->pagedir = pagedir;
+  s->upage = upage;
+
+  lock_acquire (&vm_lock);
+  vf->inode = inode;
+  vf->ofs = ofs;
+  old = hash_insert (&shared_frames, &vf->share_elem);
+  if (old != NULL)
+    {
+      vf->inode = NULL;
+      vf = hash_entry (old, struct vm_frame, share_elem);
+    }
+  if (pagedir_set_page (pagedir, upage, vf->frame, false))
+    {
+      list_push_back (&vf->sharers, &s->elem);
+      mapped = vf->frame;
+    }
+  else if (old == NULL)
+    {
+      hash_delete (&shared_frames, &vf->share_elem);
+      vf->inode = NULL;
+    }
+  lock_release (&vm_lock);
+
+  if (mapped == NULL)
+    free (s);
+  return mapped;
+}
+
+/* Returns a hash value for the shared frame containing E. */
+static unsigned shared_frame_hash (const struct hash_elem *e,
+                                   void *aux UNUSED) {
+  const struct vm_frame *vf = hash_entry (e, struct vm_frame, share_elem);
+  return hash_int ((int) vf->inode) ^ hash_int (vf->ofs);
+}
+
+/* Returns true if shared frame A precedes shared frame B. */
+static bool shared_frame_less (const struct hash_elem *a_,
+                               const struct hash_elem *b_,
+                               void *aux UNUSED) {
+  const struct vm_frame *a = hash_entry (a_, struct vm_frame, share_elem);
+  const struct vm_frame *b = hash_entry (b_, struct vm_frame, share_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  return a->ofs < b->ofs;
+}
+
+/* Returns true if any process that maps shared frame VF has
+   accessed it, clearing the accessed bits if CLEAR is true. */
+static bool shared_frame_accessed (struct vm_frame *vf, bool clear) {
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&vf->sharers); e != list_end (&vf->sharers);
+       e = list_next (e))
+    {
+      struct frame_sharer *s = list_entry (e, struct frame_sharer, elem);
+      if (pagedir_is_accessed (s->pagedir, s->upage))
+        {
+          accessed = true;
+          if (clear)
+            pagedir_set_accessed (s->pagedir, s->upage, false);
+        }
+    }
+  return accessed;
+}
+
+/* Unmaps shared frame VF from every process that maps it and
+   removes it from the shared frame table.  The page is read-only
+   and can be read back from its file, so nothing needs saving. */
+static void unshare_evicted_frame (struct vm_frame *vf) {
+  lock_acquire (&vm_lock);
+  while (!list_empty (&vf->sharers))
+    {
+      struct frame_sharer *s = list_entry (list_pop_front (&vf->sharers),
+                                           struct frame_sharer, elem);
+      struct suppl_pte *spte = get_suppl_pte (s->thread, s->upage);
+      if (spte != NULL)
+        spte->is_loaded = false;
+      pagedir_clear_page (s->pagedir, s->upage);
+      free (s);
+    }
+  hash_delete (&shared_frames, &vf->share_elem);
+  vf->inode = NULL;
+  lock_release (&vm_lock);
+
+  memset (vf->frame, 0, PGSIZE);
+}
+
+/* Records that FRAME is now mapped at UPAGE in the current
+   process.  Until this is called, a newly allocated frame is
+   never chosen for eviction, so call it only once the frame's
+   contents and mapping are complete. */
+void frame_set_usr (void *frame, void *upage) {
   struct vm_frame *vf;
+
+  lock_acquire (&vm_lock);
   vf = get_vm_frame (frame); 
   if (vf != NULL)
     {
-      vf->page_table_entry = pte;   
+      vf->owner = thread_current ();
+      vf->pagedir = thread_current ()->pagedir;
       vf->user_virtual_address = upage; 
     }
+  lock_release (&vm_lock);
+}
+
+/* Keeps the frame that UPAGE maps in the current process from
+   being evicted until vm_unpin_page() is called on UPAGE.
+   Returns false if UPAGE is not mapped, for example because it
+   has not been loaded yet or was just evicted.  Holding
+   eviction_lock means no eviction is half done, so a mapped page
+   is safe once pinned. */
+bool vm_pin_page (const void *upage) {
+  void *kpage;
+
+  lock_acquire (&eviction_lock);
+  lock_acquire (&vm_lock);
+  kpage = pagedir_get_page (thread_current ()->pagedir, upage);
+  if (kpage != NULL)
+    vm_frames[palloc_user_page_idx (kpage)].pin_cnt++;
+  lock_release (&vm_lock);
+  lock_release (&eviction_lock);
+
+  return kpage != NULL;
+}
+
+/* Undoes vm_pin_page() on UPAGE. */
+void vm_unpin_page (const void *upage) {
+  void *kpage;
+
+  lock_acquire (&vm_lock);
+  kpage = pagedir_get_page (thread_current ()->pagedir, upage);
+  if (kpage != NULL)
+    vm_frames[palloc_user_page_idx (kpage)].pin_cnt--;
+  lock_release (&vm_lock);
+}
+
+/* Keeps any frame from being evicted until
+   vm_unlock_eviction() is called.  A process holds this while it
+   tears down its page directory and supplemental page table,
+   which eviction would otherwise read as they are freed. */
+void vm_lock_eviction () {
+  lock_acquire (&eviction_lock);
+}
+
+/* Allows eviction again after vm_lock_eviction(). */
+void vm_unlock_eviction () {
+  lock_release (&eviction_lock);
 }
 
 void * evict_frame () {
@@ -75,7 +432,9 @@ void * evict_frame () {
 
   lock_acquire (&eviction_lock); 
 
+  lock_acquire (&vm_lock);
   vf = frame_to_evict ();  
+  lock_release (&vm_lock);
   if (vf == NULL)
     PANIC ("No frame to evict.");  
 
@@ -83,8 +442,8 @@ void * evict_frame () {
   if (!result)
     PANIC ("can't save evicted frame");  
   
-  vf->thread_id = t->tid;
-  vf->page_table_entry = NULL;
+  vf->owner = t;
+  vf->pagedir = t->pagedir;
   vf->user_virtual_address = NULL;
 
   lock_release (&eviction_lock);  
@@ -92,142 +451,341 @@ void * evict_frame () {
   return vf->frame;  
 }
 
+/* Chooses a frame to evict with the clock algorithm, resuming
+   where the previous search left off.  Frames fall into classes
+   by their accessed and dirty bits, and the first unaccessed,
+   clean frame the hand finds is taken, since it can be reused
+   without any I/O.  If a full sweep finds none, a second sweep
+   settles for an unaccessed, dirty frame and clears accessed
+   bits as it goes, so that the following sweeps are sure to
+   find a victim.  Frames not yet mapped into a process and
+   pinned frames are skipped. */
 static struct vm_frame *frame_to_evict () {
   struct vm_frame *vf;
-  struct thread *t;
-  struct list_elem *e;
-
-  struct vm_frame *vf_class0 = NULL;
+  int round;
+  size_t i;
 
-  int round_count = 1;
-  bool found = false;
-  
-  while (!found)
+  for (round = 0; round < 4; round++)
     {
-      e = list_head (&vm_frames);
-      while ((e = list_next (e)) != list_tail (&vm_frames))
+      bool take_dirty = round % 2 == 1;
+
+      for (i = 0; i < vm_frame_cnt; i++)
         {
-          vf = list_entry (e, struct vm_frame, elem);
-          t = thread_get_by_id (vf->thread_id);
-          bool accessed  = pagedir_is_accessed (t->pagedir, vf->user_virtual_address);
-          if (!accessed)
+          vf = &vm_frames[clock_hand];
+          clock_hand = (clock_hand + 1) % vm_frame_cnt;
+
+          if (!vf->in_use || vf->pin_cnt > 0)
+            continue;
+          if (vf->inode != NULL)
             {
-              vf_class0 = vf;
-              list_remove (e);
-              list_push_back (&vm_frames, e);
-              break;
+              /* Shared frames are read-only, so never dirty. */
+              if (!shared_frame_accessed (vf, take_dirty))
+                return vf;
+              continue;
             }
+          if (vf->user_virtual_address == NULL)
+            continue;
+
+          bool accessed = pagedir_is_accessed (vf->pagedir,
+                                               vf->user_virtual_address);
+          bool dirty = pagedir_is_dirty (vf->pagedir,
+                                         vf->user_virtual_address);
+          if (!accessed && (!dirty || take_dirty))
+            return vf;
+          if (take_dirty)
+            pagedir_set_accessed (vf->pagedir, vf->user_virtual_address,
+                                  false);
+        }
+    }
+
+  return NULL;
+}
+
+/* Takes a frame off the reserve stack and returns it, or
+   returns a null pointer if the reserve is empty. */
+static void *take_reserved_frame () {
+  struct vm_frame *vf = NULL;
+
+  lock_acquire (&vm_lock);
+  if (reserve_cnt > 0)
+    {
+      vf = &vm_frames[reserve[--reserve_cnt]];
+      vf->in_use = true;
+      vf->owner = thread_current ();
+      vf->pagedir = thread_current ()->pagedir;
+      vf->user_virtual_address = NULL;
+      vf->pin_cnt = 0;
+      used_frame_cnt++;
+      reserve_alloc_cnt++;
+    }
+  lock_release (&vm_lock);
+
+  return vf != NULL ? vf->frame : NULL;
+}
+
+/* Wakes up the pageout daemon if free frames are running low. */
+static void wake_pageout_daemon () {
+  bool wake;
+
+  lock_acquire (&vm_lock);
+  wake = (!pageout_requested
+          && vm_frame_cnt - used_frame_cnt < low_water);
+  if (wake)
+    pageout_requested = true;
+  lock_release (&vm_lock);
+
+  if (wake)
+    sema_up (&pageout_sema);
+}
+
+/* Evicts frames in the background whenever it is woken up,
+   until high_water frames are free or the reserve is full. */
+static void pageout_daemon (void *aux UNUSED) {
+  for (;;)
+    {
+      struct swap_victim batch[SWAP_BATCH_MAX];
+      size_t batch_cnt = 0;
+
+      sema_down (&pageout_sema);
+
+      lock_acquire (&eviction_lock);
+      for (;;)
+        {
+          struct vm_frame *vf;
+          enum evict_state state;
+
+          /* Frames waiting in BATCH will soon be free. */
+          lock_acquire (&vm_lock);
+          if (vm_frame_cnt - used_frame_cnt + batch_cnt >= high_water
+              || reserve_cnt + batch_cnt >= high_water)
+            vf = NULL;
+          else
+            vf = frame_to_evict ();
+          lock_release (&vm_lock);
+
+          if (vf == NULL)
+            break;
+          state = begin_eviction (vf, &batch[batch_cnt]);
+          if (state == EVICT_FAILED)
+            break;
+          if (state == EVICT_SAVED)
+            reserve_evicted_frame (vf);
           else
             {
-              pagedir_set_accessed (t->pagedir, vf->user_virtual_address, false);
+              /* Keep the clock from choosing it again. */
+              lock_acquire (&vm_lock);
+              vf->pin_cnt++;
+              lock_release (&vm_lock);
+              if (++batch_cnt == SWAP_BATCH_MAX)
+                {
+                  write_swap_batch (batch, batch_cnt);
+                  batch_cnt = 0;
+                }
             }
         }
+      write_swap_batch (batch, batch_cnt);
+      lock_release (&eviction_lock);
 
-      if (vf_class0 != NULL)
-        found = true;
-      else if (round_count++ == 2)
-        found = true;
+      lock_acquire (&vm_lock);
+      pageout_requested = false;
+      lock_release (&vm_lock);
     }
+}
 
-  return vf_class0;
+/* Writes the CNT frames in BATCH, which begin_eviction() found
+   must go to swap, to adjacent swap slots in one request, and
+   puts them on the reserve.  If there is no run of CNT free
+   slots, writes them one at a time instead. */
+static void write_swap_batch (struct swap_victim batch[], size_t cnt) {
+  void *kpages[SWAP_BATCH_MAX];
+  size_t first_slot;
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  for (i = 0; i < cnt; i++)
+    kpages[i] = batch[i].vf->frame;
+  first_slot = vm_swap_out_pages (kpages, cnt);
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct vm_frame *vf = batch[i].vf;
+      size_t swap_slot_idx = (first_slot != SWAP_ERROR
+                              ? first_slot + i
+                              : vm_swap_out (vf->frame));
+
+      lock_acquire (&vm_lock);
+      vf->pin_cnt--;
+      lock_release (&vm_lock);
+      finish_eviction (&batch[i], swap_slot_idx);
+      if (swap_slot_idx != SWAP_ERROR)
+        reserve_evicted_frame (vf);
+    }
 }
 
-static bool save_evicted_frame (struct vm_frame *vf) {
-  struct thread *t;
-  struct suppl_pte *spte;
+/* Puts VF, which the pageout daemon has evicted, on the reserve
+   stack. */
+static void reserve_evicted_frame (struct vm_frame *vf) {
+  lock_acquire (&vm_lock);
+  vf->in_use = false;
+  vf->user_virtual_address = NULL;
+  used_frame_cnt--;
+  reserve[reserve_cnt++] = vf - vm_frames;
+  pageout_cnt++;
+  lock_release (&vm_lock);
+}
 
-  t = thread_get_by_id (vf->thread_id);
+/* Prints frame allocation statistics. */
+void vm_frame_print_stats () {
+  printf ("Frames: %lld from reserve, %lld from free pool, "
+          "%lld paged out in background\n",
+          reserve_alloc_cnt, pool_alloc_cnt, pageout_cnt);
+  printf ("Frames: %lld synchronous evictions taking %lld ticks\n",
+          sync_evict_cnt, sync_evict_ticks);
+}
+
+/* Unmaps frame VF to evict it and saves it, unless it has to go
+   to swap.  Returns EVICT_SAVED if the frame is free to reuse,
+   EVICT_SWAP if the caller must write it to swap and then call
+   finish_eviction() on EV, or EVICT_FAILED if the frame could not
+   be evicted and is still in place. */
+static enum evict_state begin_eviction (struct vm_frame *vf,
+                                        struct swap_victim *ev) {
+  struct thread *t = vf->owner;
+  void *upage = vf->user_virtual_address;
+  struct suppl_pte *spte;
 
-  spte = get_suppl_pte (&t->suppl_page_table, vf->user_virtual_address);
+  trace (TRACE_EVICT, (uint32_t) vf->frame, (uint32_t) upage);
+  if (vf->inode != NULL)
+    {
+      unshare_evicted_frame (vf);
+      return EVICT_SAVED;
+    }
 
+  ev->vf = vf;
+  ev->created = false;
+  spte = get_suppl_pte (t, upage);
   if (spte == NULL)
     {
-      spte = calloc(1, sizeof *spte);
-      spte->uvaddr = vf->user_virtual_address;
+      spte = calloc (1, sizeof *spte);
+      if (spte == NULL)
+        return EVICT_FAILED;
+      spte->uvaddr = upage;
       spte->type = SWAP;
-      if (!insert_suppl_pte (&t->suppl_page_table, spte))
-        return false;
+      spte->is_loaded = true;
+      if (!insert_suppl_pte (t, spte))
+        {
+          free (spte);
+          return EVICT_FAILED;
+        }
+      ev->created = true;
     }
+  ev->spte = spte;
 
-  size_t swap_slot_idx;
+  /* Unmap the page before saving it, so that the process cannot
+     change it while it is being written out.  Clearing the PTE
+     keeps its dirty and writable bits, so they are read after it,
+     which also catches any write made just before it. */
+  pagedir_clear_page (vf->pagedir, upage);
+  ev->dirty = pagedir_is_dirty (vf->pagedir, upage);
+  ev->writable = pagedir_is_writable (vf->pagedir, upage);
 
-  if (pagedir_is_dirty (t->pagedir, spte->uvaddr)
-      && (spte->type == MMF))
+  if (spte->type == MMF)
     {
-      write_page_back_to_file_wo_lock (spte);
+      /* Mapped files are paged to the file itself, never swap. */
+      if (ev->dirty)
+        write_page_back_to_file_wo_lock (spte, vf->frame);
     }
-  else if (pagedir_is_dirty (t->pagedir, spte->uvaddr)
-           || (spte->type != FILE))
+  else if (ev->dirty || spte->type != FILE)
+    return EVICT_SWAP;
+
+  finish_eviction (ev, SWAP_ERROR);
+  return EVICT_SAVED;
+}
+
+/* Completes the eviction of EV->vf, which begin_eviction() has
+   unmapped.  If the page went to swap, SWAP_SLOT_IDX is its slot.
+   If it had to go to swap but SWAP_SLOT_IDX is SWAP_ERROR, the
+   page is put back as it was instead. */
+static void finish_eviction (struct swap_victim *ev, size_t swap_slot_idx) {
+  struct vm_frame *vf = ev->vf;
+  struct thread *t = vf->owner;
+  void *upage = vf->user_virtual_address;
+  struct suppl_pte *spte = ev->spte;
+  bool to_swap = spte->type != MMF && (ev->dirty || spte->type != FILE);
+
+  if (to_swap && swap_slot_idx == SWAP_ERROR)
     {
-      swap_slot_idx = vm_swap_out (spte->uvaddr);
-      if (swap_slot_idx == SWAP_ERROR)
-        return false;
+      pagedir_set_page (vf->pagedir, upage, vf->frame, ev->writable);
+      pagedir_set_dirty (vf->pagedir, upage, ev->dirty);
+      if (ev->created)
+        {
+          /* It has no swap slot for free_suppl_pte() to free. */
+          delete_suppl_pte (t, spte);
+          free (spte);
+        }
+      return;
+    }
 
+  if (to_swap)
+    {
       spte->type = spte->type | SWAP;
+      spte->swap_slot_idx = swap_slot_idx;
     }
+  spte->swap_writable = ev->writable;
+  spte->is_loaded = false;
 
   memset (vf->frame, 0, PGSIZE);
+}
 
-  spte->swap_slot_idx = swap_slot_idx;
-  spte->swap_writable = *(vf->page_table_entry) & PTE_W;
-
-  spte->is_loaded = false;
-
-  pagedir_clear_page (t->pagedir, spte->uvaddr);
+/* Evicts frame VF, writing it to swap if necessary.  Returns
+   true if the frame is free to reuse, false if it is still in
+   place. */
+static bool save_evicted_frame (struct vm_frame *vf) {
+  struct swap_victim ev;
+  size_t swap_slot_idx;
 
-  return true;
+  switch (begin_eviction (vf, &ev))
+    {
+    case EVICT_SAVED:
+      return true;
+    case EVICT_SWAP:
+      swap_slot_idx = vm_swap_out (vf->frame);
+      finish_eviction (&ev, swap_slot_idx);
+      return swap_slot_idx != SWAP_ERROR;
+    default:
+      return false;
+    }
 }
 
 static bool add_vm_frame (void *frame) {
-  struct vm_frame *vf;
-  vf = calloc (1, sizeof *vf);  
+  struct vm_frame *vf = &vm_frames[palloc_user_page_idx (frame)];
  
-  if (vf == NULL)   
-    return false;
-
-  vf->thread_id = thread_current ()->tid;  
-  vf->frame = frame;  
-  
   lock_acquire (&vm_lock);  
-  list_push_back (&vm_frames, &vf->elem);  
+  used_frame_cnt++;
+  vf->in_use = true;
+  vf->owner = thread_current ();
+  vf->pagedir = thread_current ()->pagedir;
+  vf->user_virtual_address = NULL;
+  vf->pin_cnt = 0;
   lock_release (&vm_lock);
 
   return true;
 }
 
 static void remove_vm_frame (void *frame) {
-  struct vm_frame *vf;
-  struct list_elem *e;
+  struct vm_frame *vf = &vm_frames[palloc_user_page_idx (frame)];
   
   lock_acquire (&vm_lock);
-  e = list_head (&vm_frames);
-  while ((e = list_next (e)) != list_tail (&vm_frames))
-    {
-      vf = list_entry (e, struct vm_frame, elem);
-      if (vf->frame == frame)
-        {
-          list_remove (e);
-          free (vf);
-          break;
-        }
-    }
+  used_frame_cnt--;
+  vf->in_use = false;
+  vf->user_virtual_address = NULL;
+  vf->pin_cnt = 0;
   lock_release (&vm_lock);
 }
 
 static struct vm_frame *get_vm_frame (void *frame) {
-  struct vm_frame *vf;
-  struct list_elem *e;
-  
-  lock_acquire (&vm_lock);
-  e = list_head (&vm_frames);
-  while ((e = list_next (e)) != list_tail (&vm_frames))
-    {
-      vf = list_entry (e, struct vm_frame, elem);
-      if (vf->frame == frame)
-        break;
-      vf = NULL;
-    }
-  lock_release (&vm_lock);
+  struct vm_frame *vf = &vm_frames[palloc_user_page_idx (frame)];
 
-  return vf;
+  return vf->in_use ? vf : NULL;
 }
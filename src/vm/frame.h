@@ -1,26 +1,70 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 
+#include <hash.h>
+#include <list.h>
+#include "filesys/off_t.h"
 #include "threads/thread.h"
+#include "threads/palloc.h"
 
+struct inode;
+
+/* Frame table entry.  There is one for every page in the user
+   pool, found by the page's index in the pool.
+
+   A frame holding a read-only page of a file is shared by every
+   process that maps that page.  Such a frame has a non-null
+   `inode', is in the table of shared frames, and lists its
+   mappings in `sharers' instead of using `owner', `pagedir' and
+   `user_virtual_address'. */
 struct vm_frame {
   void *frame;       
-  tid_t thread_id;      
-  uint32_t *page_table_entry;    
+  bool in_use;
+  struct thread *owner;
+  uint32_t *pagedir;
   void *user_virtual_address;        
-  struct list_elem elem; 
+  int pin_cnt;                  /* Pins keeping it from eviction. */
+
+  struct inode *inode;          /* Shared file page's inode, or NULL. */
+  off_t ofs;                    /* Shared file page's offset in inode. */
+  struct list sharers;          /* List of struct frame_sharer. */
+  struct hash_elem share_elem;  /* Element in shared frame table. */
 };
 
-extern struct list vm_frames;
+/* One mapping of a shared frame. */
+struct frame_sharer {
+  struct thread *thread;        /* Process mapping the frame. */
+  uint32_t *pagedir;            /* Its page directory. */
+  void *upage;                  /* User page mapped to the frame. */
+  struct list_elem elem;        /* Element in vm_frame's sharers. */
+};
 
 void vm_frame_init (void);
 
 void *vm_allocate_frame(enum palloc_flags flags);
 
+void *vm_try_allocate_frame (enum palloc_flags flags);
+
 void vm_free_frame (void *);
 
-void frame_set_usr (void*, uint32_t *, void *);
+void vm_unmap_frame (void *, uint32_t *pagedir);
+
+void *vm_share_lookup (struct inode *, off_t, void *upage);
+
+void *vm_share_register (void *, struct inode *, off_t, void *upage);
+
+void frame_set_usr (void *, void *upage);
+
+bool vm_pin_page (const void *upage);
+
+void vm_unpin_page (const void *upage);
+
+void vm_lock_eviction (void);
+
+void vm_unlock_eviction (void);
 
 void *evict_frame (void);
 
+void vm_frame_print_stats (void);
+
 #endif 
@@ -11,6 +11,10 @@
 
 static bool load_page_file (struct suppl_pte *);
 static bool load_page_swap (struct suppl_pte *);
+static int swap_in_pages (struct suppl_pte *[], void *const[], int cnt);
+static void adapt_prefetch_window (void *);
+static void prefetch_swap (void *);
+static bool prefetch_run (struct suppl_pte *[], void *const[], int cnt);
 static bool load_page_mmf (struct suppl_pte *);
 static void free_suppl_pte (struct hash_elem *, void * UNUSED);
 
@@ -36,12 +40,18 @@ bool suppl_pt_less (const struct hash_elem *hea,
   return (vsptea->uvaddr - vspteb->uvaddr) < 0;
 }
 
-struct suppl_pte *get_suppl_pte (struct hash *ht, void *uvaddr){
+/* Returns the supplemental PTE for UVADDR in thread T, or a null
+   pointer if there is none.  T's supplemental page table may be
+   accessed by the current thread only if it is T or is evicting
+   one of T's frames. */
+struct suppl_pte *get_suppl_pte (struct thread *t, void *uvaddr){
   struct suppl_pte spte;
   struct hash_elem *e;
 
   spte.uvaddr = uvaddr;
-  e = hash_find (ht, &spte.elem);
+  lock_acquire (&t->spt_lock);
+  e = hash_find (&t->suppl_page_table, &spte.elem);
+  lock_release (&t->spt_lock);
   return e != NULL ? hash_entry (e, struct suppl_pte, elem) : NULL;
 }
 
@@ -66,14 +76,30 @@ bool load_page (struct suppl_pte *spte){
   return success;
 }
 
+/* Loads a page of an executable.  Read-only pages are shared
+   among all the processes that map the same page of the same
+   file, so that, for example, a program's code is read into
+   memory only once however many processes run it. */
 static bool load_page_file (struct suppl_pte *spte) {
   struct thread *cur = thread_current ();
+  struct inode *inode = file_get_inode (spte->data.file_page.file);
+  bool writable = spte->data.file_page.writable;
+  uint8_t *kpage;
+
+  /* The frame may be evicted as soon as it is mapped, which marks
+     the page unloaded again, so mark it loaded first. */
+  spte->is_loaded = true;
+
+  if (!writable
+      && vm_share_lookup (inode, spte->data.file_page.ofs,
+                          spte->uvaddr) != NULL)
+    return true;
   
   file_seek (spte->data.file_page.file, spte->data.file_page.ofs);
 
-  uint8_t *kpage = vm_allocate_frame (PAL_USER);
+  kpage = vm_allocate_frame (PAL_USER);
   if (kpage == NULL)
-    return false;
+    goto fail;
 
   if (file_read (spte->data.file_page.file, kpage,
 		 spte->data.file_page.read_bytes)
@@ -81,33 +107,49 @@ static bool load_page_file (struct suppl_pte *spte) {
       != (int) spte->data.file_page.read_bytes)
     {
       vm_free_frame (kpage);
-      return false; 
+      goto fail;
     }
   memset (kpage + spte->data.file_page.read_bytes, 0,
 	  spte->data.file_page.zero_bytes);
+
+  if (!writable)
+    {
+      uint8_t *shared = vm_share_register (kpage, inode,
+                                           spte->data.file_page.ofs,
+                                           spte->uvaddr);
+      /* Another process may have loaded the same page meanwhile. */
+      if (shared != kpage)
+        vm_free_frame (kpage);
+      if (shared == NULL)
+        goto fail;
+      return true;
+    }
  
-  if (!pagedir_set_page (cur->pagedir, spte->uvaddr, kpage,
-			 spte->data.file_page.writable))
+  if (!pagedir_set_page (cur->pagedir, spte->uvaddr, kpage, true))
     {
       vm_free_frame (kpage);
-      return false; 
+      goto fail;
     }
-  
-  spte->is_loaded = true;
+  frame_set_usr (kpage, spte->uvaddr);
   return true;
+
+ fail:
+  spte->is_loaded = false;
+  return false;
 }
 
 static bool load_page_mmf (struct suppl_pte *spte){
   struct thread *cur = thread_current ();
 
-  file_seek (spte->data.mmf_page.file, spte->data.mmf_page.ofs);
-
   uint8_t *kpage = vm_allocate_frame (PAL_USER);
   if (kpage == NULL)
     return false;
 
-  if (file_read (spte->data.mmf_page.file, kpage,
-		 spte->data.mmf_page.read_bytes)
+  /* The evictor may be writing back another page of the same
+     file, so don't rely on the file position. */
+  if (file_read_at (spte->data.mmf_page.file, kpage,
+                    spte->data.mmf_page.read_bytes,
+                    spte->data.mmf_page.ofs)
       != (int) spte->data.mmf_page.read_bytes)
     {
       vm_free_frame (kpage);
@@ -121,40 +163,181 @@ static bool load_page_mmf (struct suppl_pte *spte){
       vm_free_frame (kpage);
       return false; 
     }
-
   spte->is_loaded = true;
   if (spte->type & SWAP)
     spte->type = MMF;
+  frame_set_usr (kpage, spte->uvaddr);
 
   return true;
 }
 
+/* Maximum number of pages prefetched on one swap-in fault.
+   Bounded by the size of struct thread's prefetched[] and by
+   SWAP_BATCH_MAX. */
+#define PREFETCH_MAX 8
+
 static bool load_page_swap (struct suppl_pte *spte){
+  void *upage = spte->uvaddr;
   
-  uint8_t *kpage = vm_allocate_frame (PAL_USER);
+  void *kpage = vm_allocate_frame (PAL_USER);
   if (kpage == NULL)
     return false;
 
-  if (!pagedir_set_page (thread_current ()->pagedir, spte->uvaddr, kpage, 
-			 spte->swap_writable))
+  if (swap_in_pages (&spte, &kpage, 1) != 1)
     {
       vm_free_frame (kpage);
       return false;
     }
 
-  vm_swap_in (spte->swap_slot_idx, spte->uvaddr);
+  adapt_prefetch_window (upage);
+  prefetch_swap (upage);
+  return true;
+}
+
+/* Reads the CNT pages described by SPTES, which are in adjacent
+   swap slots in order, into the frames KPAGES with a single
+   request and maps them into the current process.  Returns the
+   number of pages, counting from the first, that were swapped
+   in.  The rest keep their swap slots, and their frames are left
+   unused.  The SPTES of pages swapped in may be freed. */
+static int swap_in_pages (struct suppl_pte *sptes[], void *const kpages[],
+                          int cnt){
+  struct thread *t = thread_current ();
+  int n, i;
+
+  /* Map the pages before reading them in, because reading frees
+     their swap slots, which must stay allocated if mapping fails.
+     The process is in the kernel, so it cannot touch the pages
+     before they are read. */
+  for (n = 0; n < cnt; n++)
+    if (!pagedir_set_page (t->pagedir, sptes[n]->uvaddr, kpages[n],
+                           sptes[n]->swap_writable))
+      break;
+  if (n > 0)
+    vm_swap_in_pages (sptes[0]->swap_slot_idx, kpages, n);
 
-  if (spte->type == SWAP)
+  for (i = 0; i < n; i++)
     {
-      hash_delete (&thread_current ()->suppl_page_table, &spte->elem);
+      struct suppl_pte *spte = sptes[i];
+      void *upage = spte->uvaddr;
+
+      if (spte->type == SWAP)
+        {
+          delete_suppl_pte (t, spte);
+          free (spte);
+        }
+      else if (spte->type == (FILE | SWAP))
+        {
+          /* The page was modified after it was read from its file,
+             so it must go back to swap, not be dropped, if it is
+             evicted again. */
+          pagedir_set_dirty (t->pagedir, upage, true);
+          spte->type = FILE;
+          spte->is_loaded = true;
+        }
+
+      /* Only now may the evictor see the frame and, with it, the
+         supplemental PTE. */
+      frame_set_usr (kpages[i], upage);
     }
-  if (spte->type == (FILE | SWAP))
+
+  return n;
+}
+
+/* Adjusts the current process's read-around window on a swap-in
+   fault at UPAGE.  The window doubles when every page prefetched
+   at the previous fault has been used since, and halves when
+   fewer than half of them have.  A window that has shrunk to
+   zero opens again when faults arrive at consecutive pages. */
+static void adapt_prefetch_window (void *upage){
+  struct thread *t = thread_current ();
+  int used = 0;
+  int i;
+
+  for (i = 0; i < t->prefetched_cnt; i++)
+    if (pagedir_is_accessed (t->pagedir, t->prefetched[i]))
+      used++;
+
+  if (t->prefetched_cnt > 0)
     {
-      spte->type = FILE;
-      spte->is_loaded = true;
+      if (used == t->prefetched_cnt)
+        t->prefetch_window = (t->prefetch_window * 2 < PREFETCH_MAX
+                              ? t->prefetch_window * 2 : PREFETCH_MAX);
+      else if (used * 2 < t->prefetched_cnt)
+        t->prefetch_window /= 2;
     }
+  else if (t->prefetch_window == 0
+           && upage == (uint8_t *) t->last_swap_fault + PGSIZE)
+    t->prefetch_window = 1;
 
-  return true;
+  t->prefetched_cnt = 0;
+  t->last_swap_fault = upage;
+}
+
+/* Brings the swapped-out pages that follow UPAGE in the current
+   process's address space into memory, up to the process's
+   read-around window, stopping at the first page that is not in
+   swap.  Pages in adjacent swap slots, as the pageout daemon
+   leaves a batch of evictions, are read with a single request.
+   Only frames that are free anyway are used, so prefetching
+   never causes an eviction. */
+static void prefetch_swap (void *upage){
+  struct thread *t = thread_current ();
+  struct suppl_pte *sptes[PREFETCH_MAX];
+  void *kpages[PREFETCH_MAX];
+  int cnt = 0;
+  int i;
+
+  for (i = 1; i <= t->prefetch_window; i++)
+    {
+      void *next = (uint8_t *) upage + i * PGSIZE;
+      struct suppl_pte *spte;
+      void *kpage;
+
+      if (!is_user_vaddr (next) || pagedir_get_page (t->pagedir, next))
+        break;
+      spte = get_suppl_pte (t, next);
+      if (spte == NULL
+          || (spte->type != SWAP && spte->type != (FILE | SWAP)))
+        break;
+
+      if (cnt > 0
+          && spte->swap_slot_idx != sptes[cnt - 1]->swap_slot_idx + 1)
+        {
+          bool ok = prefetch_run (sptes, kpages, cnt);
+          cnt = 0;
+          if (!ok)
+            break;
+        }
+
+      kpage = vm_try_allocate_frame (PAL_USER);
+      if (kpage == NULL)
+        break;
+      sptes[cnt] = spte;
+      kpages[cnt++] = kpage;
+    }
+  prefetch_run (sptes, kpages, cnt);
+}
+
+/* Swaps in the CNT pages described by SPTES, which are in adjacent
+   swap slots, into the frames KPAGES, and records them as
+   prefetched.  Frees the frames of any pages that could not be
+   swapped in.  Returns true if all of them were. */
+static bool prefetch_run (struct suppl_pte *sptes[], void *const kpages[],
+                          int cnt){
+  struct thread *t = thread_current ();
+  void *upages[PREFETCH_MAX];
+  int n, i;
+
+  for (i = 0; i < cnt; i++)
+    upages[i] = sptes[i]->uvaddr;
+  n = swap_in_pages (sptes, kpages, cnt);
+  for (i = 0; i < cnt; i++)
+    if (i < n)
+      t->prefetched[t->prefetched_cnt++] = upages[i];
+    else
+      vm_free_frame (kpages[i]);
+  return n == cnt;
 }
 
 void free_suppl_pt (struct hash *suppl_pt) {
@@ -170,23 +353,34 @@ static void free_suppl_pte (struct hash_elem *e, void *aux UNUSED){
   free (spte);
 }
 
-bool insert_suppl_pte (struct hash *spt, struct suppl_pte *spte){
+/* Adds SPTE to thread T's supplemental page table.  Returns
+   false if T already has an entry for the same page. */
+bool insert_suppl_pte (struct thread *t, struct suppl_pte *spte){
   struct hash_elem *result;
 
   if (spte == NULL)
     return false;
   
-  result = hash_insert (spt, &spte->elem);
+  lock_acquire (&t->spt_lock);
+  result = hash_insert (&t->suppl_page_table, &spte->elem);
+  lock_release (&t->spt_lock);
   if (result != NULL)
     return false;
   
   return true;
 }
 
+/* Removes SPTE from thread T's supplemental page table, without
+   freeing it. */
+void delete_suppl_pte (struct thread *t, struct suppl_pte *spte){
+  lock_acquire (&t->spt_lock);
+  hash_delete (&t->suppl_page_table, &spte->elem);
+  lock_release (&t->spt_lock);
+}
+
 bool suppl_pt_insert_file (struct file *file, off_t ofs, uint8_t *upage, 
 		      uint32_t read_bytes, uint32_t zero_bytes, bool writable){
   struct suppl_pte *spte; 
-  struct hash_elem *result;
   struct thread *cur = thread_current ();
 
   spte = calloc (1, sizeof *spte);
@@ -203,9 +397,11 @@ bool suppl_pt_insert_file (struct file *file, off_t ofs, uint8_t *upage,
   spte->data.file_page.writable = writable;
   spte->is_loaded = false;
       
-  result = hash_insert (&cur->suppl_page_table, &spte->elem);
-  if (result != NULL)
-    return false;
+  if (!insert_suppl_pte (cur, spte))
+    {
+      free (spte);
+      return false;
+    }
 
   return true;
 }
@@ -213,7 +409,6 @@ bool suppl_pt_insert_file (struct file *file, off_t ofs, uint8_t *upage,
 bool suppl_pt_insert_mmf (struct file *file, off_t ofs, uint8_t *upage, 
 		      uint32_t read_bytes){
   struct suppl_pte *spte; 
-  struct hash_elem *result;
   struct thread *cur = thread_current ();
 
   spte = calloc (1, sizeof *spte);
@@ -228,34 +423,108 @@ bool suppl_pt_insert_mmf (struct file *file, off_t ofs, uint8_t *upage,
   spte->data.mmf_page.read_bytes = read_bytes;
   spte->is_loaded = false;
       
-  result = hash_insert (&cur->suppl_page_table, &spte->elem);
-  if (result != NULL)
-    return false;
+  if (!insert_suppl_pte (cur, spte))
+    {
+      free (spte);
+      return false;
+    }
 
   return true;
 }
 
-void write_page_back_to_file_wo_lock (struct suppl_pte *spte){
+/* Writes KPAGE, the frame holding the memory-mapped file page
+   described by SPTE, back to the file.  KPAGE is used rather
+   than the user address because the caller may be running in
+   another process. */
+void write_page_back_to_file_wo_lock (struct suppl_pte *spte, void *kpage){
   if (spte->type == MMF)
+    file_write_at (spte->data.mmf_page.file, kpage,
+                   spte->data.mmf_page.read_bytes,
+                   spte->data.mmf_page.ofs);
+}
+
+/* Removes UPAGE, a page of a memory-mapped file, from the
+   current process, first writing it back to the file if the
+   process modified it. */
+void suppl_pt_remove_mmf (void *upage){
+  struct thread *t = thread_current ();
+  struct suppl_pte *spte;
+
+  /* Keep the evictor from writing the page back at the same
+     time. */
+  vm_lock_eviction ();
+  spte = get_suppl_pte (t, upage);
+  if (spte != NULL && spte->type == MMF)
     {
-      file_seek (spte->data.mmf_page.file, spte->data.mmf_page.ofs);
-      file_write (spte->data.mmf_page.file, 
-                  spte->uvaddr,
-                  spte->data.mmf_page.read_bytes);
+      if (spte->is_loaded)
+        {
+          void *kpage = pagedir_get_page (t->pagedir, upage);
+          if (pagedir_is_dirty (t->pagedir, upage))
+            write_page_back_to_file_wo_lock (spte, kpage);
+          pagedir_clear_page (t->pagedir, upage);
+          vm_free_frame (kpage);
+        }
+      delete_suppl_pte (t, spte);
+      free (spte);
     }
+  vm_unlock_eviction ();
 }
 
-void grow_stack (void *uvaddr){
+/* Maps a new zeroed page at the page containing UVADDR in the
+   current process's stack.  Returns true if successful. */
+bool grow_stack (void *uvaddr){
   void *spage;
+  void *upage = pg_round_down (uvaddr);
   struct thread *t = thread_current ();
   spage = vm_allocate_frame (PAL_USER | PAL_ZERO);
   if (spage == NULL)
-    return;
-  else
+    return false;
+  if (!pagedir_set_page (t->pagedir, upage, spage, true))
+    {
+      vm_free_frame (spage); 
+      return false;
+    }
+  frame_set_usr (spage, upage);
+  return true;
+}
+
+/* Returns true if a fault at FAULT_ADDR, with the user stack
+   pointer at ESP, is an access to the stack below the pages
+   mapped so far.  PUSHA writes 32 bytes below the stack pointer
+   before moving it, so that is the farthest below ESP a valid
+   access can fault. */
+static bool is_stack_access (void *fault_addr, void *esp) {
+  return ((uint8_t *) fault_addr >= (uint8_t *) esp - 32
+          && (uint8_t *) fault_addr >= (uint8_t *) PHYS_BASE - STACK_SIZE
+          && is_user_vaddr (fault_addr));
+}
+
+/* Resolves a not-present fault at user address FAULT_ADDR in
+   the current process, whose user stack pointer is ESP, by
+   loading the page from its file or swap or by growing the
+   stack.  Returns true if the faulting access can be retried,
+   false if the access was invalid. */
+bool vm_page_fault (void *fault_addr, void *esp) {
+  struct thread *t = thread_current ();
+  struct suppl_pte *spte;
+
+  if (t->pagedir == NULL)
+    return false;
+
+  spte = get_suppl_pte (t, pg_round_down (fault_addr));
+  if (spte != NULL)
     {
-      if (!pagedir_set_page (t->pagedir, pg_round_down (uvaddr), spage, true))
-	{
-	  vm_free_frame (spage); 
-	}
+      /* A loaded page faults only while it is being evicted,
+         which unmaps it before saving it.  Wait for that to
+         finish. */
+      if (spte->is_loaded)
+        {
+          vm_lock_eviction ();
+          vm_unlock_eviction ();
+        }
+      return !spte->is_loaded && load_page (spte);
     }
+  if (is_stack_access (fault_addr, esp))
+    return grow_stack (fault_addr);
+  return false;
 }
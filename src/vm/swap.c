@@ -10,56 +10,119 @@
 
 struct block *swap_device;
 
+/* Swap slots, one bit per page-sized slot, true if in use. */
 static struct bitmap *swap_map;
+static struct lock swap_lock;
+
+/* Slot where the search for a free slot starts.  Allocating
+   next-fit keeps pages that are swapped out one after another,
+   as in a burst of evictions, in adjacent slots, so they can be
+   read back with long sequential transfers. */
+static size_t swap_hint;
 
 static size_t SECTORS_PER_PAGE = PGSIZE / BLOCK_SECTOR_SIZE;
 static size_t swap_size_in_page (void);
+static size_t swap_alloc (size_t cnt);
+static void swap_transfer (size_t, void *const[], size_t, bool write);
 
 void vm_swap_init () {
+  lock_init (&swap_lock);
+  swap_hint = 0;
+
+  /* Without a swap device, pages that must be swapped out cannot
+     be evicted, but clean file pages still can. */
   swap_device = block_get_role (BLOCK_SWAP);
   if (swap_device == NULL)
-    PANIC ("no swap device found, can't initialize swap");
+    return;
 
   swap_map = bitmap_create (swap_size_in_page ());
   if (swap_map == NULL)
     PANIC ("swap bitmap creation failed");
- 
-  bitmap_set_all (swap_map, true);
 }
 
-size_t vm_swap_out (const void *uva){
-  size_t swap_idx = bitmap_scan_and_flip (swap_map, 0, 1, true);
-    
-  if (swap_idx == BITMAP_ERROR)
+/* Allocates CNT adjacent swap slots and returns the first, or
+   SWAP_ERROR if there is no such run of free slots. */
+static size_t swap_alloc (size_t cnt) {
+  size_t swap_idx;
+
+  if (swap_map == NULL)
     return SWAP_ERROR;
 
-  size_t counter = 0;
-  while (counter < SECTORS_PER_PAGE)
+  lock_acquire (&swap_lock);
+  swap_idx = bitmap_scan_and_flip (swap_map, swap_hint, cnt, false);
+  if (swap_idx == BITMAP_ERROR && swap_hint != 0)
+    swap_idx = bitmap_scan_and_flip (swap_map, 0, cnt, false);
+  if (swap_idx != BITMAP_ERROR)
+    swap_hint = (swap_idx + cnt) % bitmap_size (swap_map);
+  lock_release (&swap_lock);
+
+  return swap_idx == BITMAP_ERROR ? SWAP_ERROR : swap_idx;
+}
+
+/* Reads (if WRITE is false) or writes the CNT pages in KPAGES
+   from or to swap slots SWAP_IDX onward, with a single request
+   that gathers or scatters the pages. */
+static void swap_transfer (size_t swap_idx, void *const kpages[],
+                           size_t cnt, bool write) {
+  struct block_iovec iov[SWAP_BATCH_MAX];
+  size_t i;
+
+  ASSERT (cnt <= SWAP_BATCH_MAX);
+  for (i = 0; i < cnt; i++)
     {
-      block_write (swap_device, swap_idx * SECTORS_PER_PAGE + counter, 
-		   uva + counter * BLOCK_SECTOR_SIZE);
-      counter++;
+      iov[i].buffer = kpages[i];
+      iov[i].cnt = SECTORS_PER_PAGE;
     }
+  if (write)
+    block_writev (swap_device, swap_idx * SECTORS_PER_PAGE, iov, cnt);
+  else
+    block_readv (swap_device, swap_idx * SECTORS_PER_PAGE, iov, cnt);
+}
+
+/* Writes the page at kernel address KPAGE to a newly allocated
+   swap slot and returns the slot, or SWAP_ERROR if swap is
+   full. */
+size_t vm_swap_out (const void *kpage){
+  void *page = (void *) kpage;
+
+  return vm_swap_out_pages (&page, 1);
+}
+
+/* Writes the CNT pages at kernel addresses KPAGES, at most
+   SWAP_BATCH_MAX of them, to CNT newly allocated adjacent swap
+   slots in one long sequential transfer.  Returns the first
+   slot, which holds KPAGES[0], or SWAP_ERROR if there is no run
+   of CNT free slots. */
+size_t vm_swap_out_pages (void *const kpages[], size_t cnt){
+  size_t swap_idx = swap_alloc (cnt);
+    
+  if (swap_idx == SWAP_ERROR)
+    return SWAP_ERROR;
+
+  swap_transfer (swap_idx, kpages, cnt, true);
   return swap_idx;
 }
 
-void vm_swap_in (size_t swap_idx, void *uva){
-  size_t counter = 0;
-  while (counter < SECTORS_PER_PAGE)
-    {
-      block_read (swap_device, swap_idx * SECTORS_PER_PAGE + counter,
-		  uva + counter * BLOCK_SECTOR_SIZE);
-      counter++;
-    }
-  bitmap_flip (swap_map, swap_idx);
+/* Reads the CNT adjacent swap slots starting at SWAP_IDX, at most
+   SWAP_BATCH_MAX of them, into the pages at kernel addresses
+   KPAGES in one transfer, and frees the slots. */
+void vm_swap_in_pages (size_t swap_idx, void *const kpages[], size_t cnt){
+  size_t i;
+
+  swap_transfer (swap_idx, kpages, cnt, false);
+  for (i = 0; i < cnt; i++)
+    vm_clear_swap_slot (swap_idx + i);
 }
 
+/* Frees swap slot SWAP_IDX, which must be in use. */
 void vm_clear_swap_slot (size_t swap_idx){
-  bitmap_flip (swap_map, swap_idx);  
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_map, swap_idx));
+  bitmap_reset (swap_map, swap_idx);
+  lock_release (&swap_lock);
 }
 
 static size_t
 swap_size_in_page (){
   return block_size (swap_device) / SECTORS_PER_PAGE;
 }
-
@@ -3,11 +3,17 @@
 
 #define SWAP_ERROR SIZE_MAX
 
+/* Most pages moved by one vm_swap_out_pages() or
+   vm_swap_in_pages() call. */
+#define SWAP_BATCH_MAX 16
+
 void vm_swap_init (void);
 
 size_t vm_swap_out (const void *);
 
-void vm_swap_in (size_t, void *);
+size_t vm_swap_out_pages (void *const kpages[], size_t cnt);
+
+void vm_swap_in_pages (size_t, void *const kpages[], size_t cnt);
 
 void vm_clear_swap_slot (size_t);
 #endif 